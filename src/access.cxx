@@ -6,6 +6,9 @@
 #include "xs.hxx"
 #include "prim.hxx"
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
 
 #define	READ	4
 #define	WRITE	2
@@ -76,7 +79,8 @@ static int testfile(const char *path, int perm, mode_t type) {
 
 static const char *pathcat(const char *prefix, const char *suffix) {
 	std::string result = std::string(prefix);
-	if (*result.rbegin() != '/') result.push_back('/');
+	if (!result.empty() && *result.rbegin() != '/')
+		result.push_back('/');
 	result += suffix;
 	return gcdup(result.c_str());
 }
@@ -130,16 +134,16 @@ PRIM(access) {
 		if (first) {
 			if (error == 0) {
 				List* result = 
-					mklist(mkstr(suffix == NULL
+					mkstrcell(suffix == NULL
 							? name
-							: gcdup(name)),
+							: gcdup(name),
 					       NULL);
 				
 				return result;
 			} else if (error != ENOENT)
 				estatus = error;
 		} else
-			lp = mklist(mkstr(error == 0 ? "0" : xsstrerror(error)),
+			lp = mkstrcell(error == 0 ? "0" : xsstrerror(error),
 				    lp);
 	}
 
@@ -153,8 +157,139 @@ PRIM(access) {
 	return reverse(lp);
 }
 
+/*
+ * the command path cache
+ *	$&pathsearch remembers where it found each command.  an entry is
+ *	trusted while $path is the same list and the directories searched
+ *	to find it keep the modification times they had then, which costs
+ *	a stat of each of those directories instead of a search.  since
+ *	the times are in seconds, a directory whose time was the current
+ *	second when it was looked at is not trusted.  names with slashes,
+ *	and commands found after a relative directory, are not remembered.
+ */
+
+struct Pathdir {
+	std::string name;
+	time_t mtime;
+	bool stable;		/* mtime was in the past when seen */
+};
+
+struct Hashed {
+	size_t dir;		/* index in pathdirs */
+	std::string path;
+};
+
+static List *pathdefn = NULL;	/* $path when pathdirs was built */
+static std::vector<Pathdir> pathdirs;
+static std::unordered_map<std::string, Hashed> hashed;
+
+/* rehash -- forget all remembered commands */
+static void rehash(void) {
+	hashed.clear();
+	for (size_t i = 0; i < pathdirs.size(); i++)
+		pathdirs[i].stable = false;
+}
+
+/* dircurrent -- does a directory still have its remembered mtime? */
+static bool dircurrent(Pathdir *dir, time_t now) {
+	struct stat st;
+	if (stat(dir->name.c_str(), &st) == -1) {
+		dir->stable = false;
+		return false;
+	}
+	bool same = dir->stable && st.st_mtime == dir->mtime;
+	dir->mtime = st.st_mtime;
+	dir->stable = st.st_mtime < now;
+	return same;
+}
+
+/* hashsearch -- find an executable on $path, through the cache */
+static const char *hashsearch(const char *name) {
+	List *path = varlookup("path", NULL);
+	if (path != pathdefn) {
+		pathdefn = path;
+		pathdirs.clear();
+		hashed.clear();
+		for (List *lp = path; lp != NULL; lp = lp->next) {
+			Pathdir dir = { getstr(lp->term), 0, false };
+			pathdirs.push_back(dir);
+		}
+	}
+
+	bool cacheable = strchr(name, '/') == NULL;
+	time_t now = time(NULL);
+	if (cacheable) {
+		auto i = hashed.find(name);
+		if (i != hashed.end()) {
+			size_t d;
+			for (d = 0; d <= i->second.dir; d++)
+				if (!dircurrent(&pathdirs[d], now))
+					break;
+			if (d > i->second.dir)
+				return gcdup(i->second.path.c_str());
+			rehash();
+		}
+	}
+
+	int estatus = ENOENT;
+	for (size_t d = 0; d < pathdirs.size(); d++) {
+		Pathdir *dir = &pathdirs[d];
+		const char *file = pathcat(dir->name.c_str(), name);
+		if (dir->name[0] != '/')
+			cacheable = false;
+		else if (cacheable)
+			dircurrent(dir, now);
+		int error = testfile(file, EXEC, S_IFREG);
+		if (error == 0) {
+			if (cacheable) {
+				Hashed h = { d, file };
+				hashed[name] = h;
+			}
+			return file;
+		}
+		if (error != ENOENT)
+			estatus = error;
+	}
+	fail("$&pathsearch", "%s: %s", name, xsstrerror(estatus));
+	NOTREACHED;
+}
+
+PRIM(pathsearch) {
+	(void)binding;
+	(void)evalflags;
+	if (list == NULL || list->next != NULL)
+		fail("$&pathsearch", "usage: $&pathsearch name");
+	return mkstrcell(hashsearch(getstr(list->term)), NULL);
+}
+
+PRIM(pathcache) {
+	(void)list;
+	(void)binding;
+	(void)evalflags;
+	std::vector<std::string> names;
+	for (auto i = hashed.begin(); i != hashed.end(); ++i)
+		names.push_back(i->first);
+	std::sort(names.begin(), names.end());
+	List *result = NULL;
+	for (size_t i = names.size(); i-- > 0;)
+		result = mkstrcell(gcdup(hashed[names[i]].path.c_str()),
+				result);
+	return result;
+}
+
+PRIM(rehash) {
+	(void)list;
+	(void)binding;
+	(void)evalflags;
+	rehash();
+	return ltrue;
+}
+
 extern void initprims_access(Prim_dict& primdict) {
 	X(access);
+	X(pathsearch);
+	X(pathcache);
+	X(rehash);
 }
 
 extern const char *checkexecutable(const char *file) {
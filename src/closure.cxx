@@ -1,6 +1,7 @@
 /* closure.cxx -- operations on bindings, closures, lambdas, and thunks */
 
 #include "xs.hxx"
+#include "term.hxx"
 #include <stdint.h>
 #include <map>
 
@@ -8,6 +9,9 @@ extern Closure *mkclosure(Tree* tree, Binding* binding) {
 	Closure* closure = gcnew(Closure);
 	closure->tree = tree;
 	closure->binding = binding;
+	closure->code = NULL;
+	closure->text = NULL;
+	closure->gen = 0;
 	return closure;;
 }
 
@@ -155,9 +159,36 @@ extern Binding *mkbinding(const char* name, List* defn, Binding* next) {
 	binding->name = name;
 	binding->defn = defn;
 	binding->next = next;
+	binding->slot = 0;
+	binding->gen = 0;
 	return binding;
 }
 
+/* mkframe -- allocate the cells of a frame of n variables, already linked */
+extern Binding *mkframe(int n, Binding* next) {
+	Binding *frame = reinterpret_cast<Binding *>(galloc(n * sizeof (Binding)));
+	for (int i = 0; i < n; i++) {
+		frame[i].slot = i;
+		frame[i].gen = 0;
+		frame[i].next = (i == 0) ? next : &frame[i - 1];
+	}
+	return frame;
+}
+
+/* frameskip -- the bindings outside the innermost depth frames */
+extern Binding *frameskip(Binding *binding, int depth) {
+	for (; depth > 0; --depth)
+		binding = (binding - binding->slot)->next;
+	return binding;
+}
+
+/* framelookup -- the cell of a variable addressed by frame and slot */
+extern Binding *framelookup(Binding *binding, int depth, int slot) {
+	binding = frameskip(binding, depth);
+	assert(binding != NULL && slot <= binding->slot);
+	return binding - (binding->slot - slot);
+}
+
 extern Binding *reversebindings(Binding *binding) {
 	if (binding == NULL)
 		return NULL;
@@ -172,3 +203,42 @@ extern Binding *reversebindings(Binding *binding) {
 		return prev;
 	}
 }
+
+
+/*
+ * printed closures
+ *	the printed form of a closure depends only on its tree, which never
+ *	changes, and on the values in its bindings, which change only when
+ *	assigned.  each assignment stamps the binding with a new generation,
+ *	so a remembered printed form is good as long as no binding it shows,
+ *	directly or through the closures in their values, is newer than it.
+ */
+
+unsigned long bindgen = 0;
+
+static bool boundsince(Binding *binding, unsigned long gen) {
+	for (; binding != NULL; binding = binding->next)
+		if (binding->gen > gen || reboundsince(binding->defn, gen))
+			return true;
+	return false;
+}
+
+/* reboundsince -- has any binding seen by the closures in list been assigned after gen? */
+extern bool reboundsince(List *list, unsigned long gen) {
+	for (; list != NULL; list = list->next) {
+		Closure *closure = list->term->closure;
+		if (closure != NULL && boundsince(closure->binding, gen))
+			return true;
+	}
+	return false;
+}
+
+/* closuretext -- the printed form of a closure, remembered until rebound */
+extern const char *closuretext(Closure *closure) {
+	if (closure->text == NULL
+	    || boundsince(closure->binding, closure->gen)) {
+		closure->gen = bindgen;
+		closure->text = str("%C", closure);
+	}
+	return closure->text;
+}
@@ -0,0 +1,122 @@
+/* code.hxx -- compiled form of parse trees */
+
+/*
+ * a Code is a flat array of instructions for one command (the body of a
+ * thunk or lambda, or a nested command such as the body of a for loop).
+ * word lists are built on a stack of frames: Mark opens a frame, the
+ * word-producing instructions append to the frame on top, and the
+ * instructions that consume lists (Concat, Var, Bind, Eval, ...) pop it.
+ * every Code ends with exactly one of the command instructions (True
+ * through Result), which produces the value of the command.
+ *
+ * the terms of literal words are made when the code is compiled and are
+ * never changed.  a run of words that need no globbing is made into one
+ * list, which is shared by every evaluation instead of being rebuilt.
+ */
+
+enum Opcode {
+	/* word lists */
+	opMark,		/* i: open a frame; quoted (glob-able) if i != 0 */
+	opWord,		/* list: append a copy of the unquoted word */
+	opLiteral,	/* list: append the literal words, shared */
+	opPrim,		/* t: append the primitive named by tree t */
+	opClosure,	/* t: append a closure of thunk or lambda t; body */
+	opVar,		/* pop names, append the values of those variables */
+	opLexical,	/* s: append the variable in frame i, slot j */
+	opLookup,	/* sym: append the variable, skipping i frames (all if < 0) */
+	opVarname,	/* pop one name, open a frame holding its value */
+	opSubscript,	/* pop subscripts and value, append the selection */
+	opConcat,	/* pop two frames, append their cross product */
+	opArith,	/* arith: append the value of an arithmetic program */
+	opCall,		/* body: run the command, append its result */
+	opCount,	/* pop a list, append its length as %count would */
+
+	/* bindings */
+	opBindings,	/* start new bindings: on top of current if i == 0;
+			   as one frame of j variables if j >= 0 */
+	opBind,		/* pop values and names, add let-style bindings */
+	opForbind,	/* pop values and names, add for-style bindings */
+	opEnter,	/* make the new bindings current */
+	opLocal,	/* body: run body with new bindings made dynamic */
+	opFor,		/* body: loop over the new bindings running body */
+
+	/* commands */
+	opTrue,		/* the empty command */
+	opEval,		/* pop a list, run it as a command */
+	opAssign,	/* pop values and names, assign them */
+	opSetlexical,	/* s: pop values, assign variable in frame i, slot j */
+	opMatch,	/* pop patterns and subjects, match */
+	opExtract,	/* pop patterns and subjects, extract matches */
+	opResult	/* pop a list, return it (for closures over lists) */
+};
+
+struct Code;
+struct Arith;
+
+struct Op {
+	Opcode kind;
+	int i, j;
+	union {
+		const char *s;
+		Tree *t;
+		Symbol *sym;
+		Arith *arith;
+		List *list;
+	} u;
+	Code *body;		/* nested code */
+};
+
+struct Code {
+	Op *ops;
+	int nops;
+	int depth;		/* maximum number of frames in use at once */
+};
+
+/*
+ * an arithmetic expression is compiled to a program for a small stack
+ * machine over unboxed numbers.  literals are read when the program is
+ * compiled, and operators whose operands are all constant are evaluated
+ * then, so only the parts that depend on variables are left to run.
+ */
+
+enum Arithop {
+	aConst,		/* n: push a number */
+	aLexical,	/* s: push the variable in frame i, slot j */
+	aLookup,	/* sym: push the variable, skipping i frames (all if < 0) */
+	aName,		/* s: push the variable, looked up by name */
+	aBad,		/* s: fail with message s (for a malformed literal) */
+
+	/* operators; unary ones replace the top, binary ones pop two */
+	aNegate,
+	aPlus, aMinus, aMult, aDivide, aModulus, aPow,
+	aLess, aLessEqual, aGreater, aGreaterEqual, aEqual, aNotEqual
+};
+
+struct Number {
+	int type;	/* num_int or num_float */
+	union {
+		int64_t i;
+		double d;
+	} u;
+};
+
+struct Aop {
+	Arithop kind;
+	int i, j;
+	bool count;	/* for variables: push the length, not the value */
+	union {
+		Number n;
+		Symbol *sym;
+		const char *s;
+	} u;
+};
+
+struct Arith {
+	Aop *ops;
+	int nops;
+	int depth;	/* the most numbers on the stack at once */
+	Tree *tree;	/* the source, for printing */
+};
+
+extern Number arithop(Arithop kind, Number a, Number b);
+extern List *calculate(Arith *arith, Binding *binding);
@@ -0,0 +1,730 @@
+/* compile.cxx -- lower parse trees to flat code for execute() */
+
+#include "xs.hxx"
+#include "term.hxx"
+#include "code.hxx"
+#include "var.hxx"
+#include "print.hxx"
+#include "prim.hxx"
+#include <list>
+#include <vector>
+
+/*
+ * scopes
+ *	the compiler mirrors the chain of lexical frames that will exist
+ *	when the code runs:  one frame for the parameters of a lambda, for
+ *	the variables of a let or closure, and for each pass through a for
+ *	loop.  a frame whose names aren't all literal words is opaque;
+ *	nothing can be resolved through it, so references that reach it
+ *	fall back to looking the name up.  the end of the chain is either
+ *	opaque (the bindings of a closure we know nothing about) or, for
+ *	closures with no bindings, the global variables.
+ */
+
+struct Scope {
+	std::vector<const char *> names;
+	bool opaque;
+	Scope *next;
+};
+
+static Scope opaquescope = { std::vector<const char *>(), true, NULL };
+
+/* literalnames -- collect the names of a list of words, if all are literal */
+static bool literalnames(Tree *tree, std::vector<const char *> &names) {
+	for (; tree != NULL; tree = tree->u[1].p)
+		switch (tree->kind) {
+		case nWord: case nQword:
+			names.push_back(tree->u[0].s);
+			return true;
+		case nList:
+			if (!literalnames(tree->u[0].p, names))
+				return false;
+			break;
+		default:
+			return false;
+		}
+	return true;
+}
+
+/* defnnames -- collect the names bound by a let, local, or for */
+static bool defnnames(Tree *defn, std::vector<const char *> &names) {
+	for (; defn != NULL; defn = defn->u[1].p)
+		if (defn->u[0].p != NULL
+		    && !literalnames(defn->u[0].p->u[0].p, names))
+			return false;
+	return true;
+}
+
+/* resolve -- find the address of a variable; false if it must be looked up */
+static bool resolve(Scope *scope, const char *name, int *depthp, int *slotp) {
+	int depth = 0;
+	for (; scope != NULL && !scope->opaque; scope = scope->next, depth++)
+		for (int slot = scope->names.size(); slot-- > 0;)
+			if (streq(scope->names[slot], name)) {
+				*depthp = depth;
+				*slotp = slot;
+				return true;
+			}
+	*depthp = (scope == NULL) ? -1 : depth;
+	return false;
+}
+
+
+/*
+ * the compiler
+ *	a single pass over the tree; besides the instructions, it keeps
+ *	track of how deep the frame stack gets and of the lexical scope.
+ *	nested code, including the bodies of closures, is compiled along
+ *	with the code around it, since it shares its scope.
+ */
+
+class Compiler {
+public:
+	Compiler(Scope *scope)
+		: depth(0), maxdepth(0), scope(scope), exact(false) {}
+	void command(Tree *tree);
+	void result(Tree *tree);
+	Code *finish();
+private:
+	void emit(Opcode kind, int i = 0, Tree *t = NULL, Code *body = NULL);
+	void emits(Opcode kind, const char *s, int i = 0, int j = 0);
+	void mark(bool quoted);
+	void pop(int n) { depth -= n; }
+	void words(Tree *tree, bool quoted);
+	Tree *literals(Tree *tree, bool quoted);
+	void list(Tree *tree, bool quoted);
+	void var(Tree *name);
+	void bindings(Tree *defn, Opcode bind);
+
+	std::vector< Op, gc_allocator<Op> > ops;
+	int depth, maxdepth;
+	Scope *scope;
+	std::list<Scope> lets;		/* scopes opened by let in this code */
+	bool exact;			/* in a concatenation that may glob */
+};
+
+static Code *compile(Tree *tree, Scope *scope);
+static Code *bodycode(Tree *tree, Scope *scope);
+static Arith *arith(Tree *tree, Scope *scope);
+
+void Compiler::emit(Opcode kind, int i, Tree *t, Code *body) {
+	Op op;
+	op.kind = kind;
+	op.i = i;
+	op.j = 0;
+	op.u.t = t;
+	op.body = body;
+	ops.push_back(op);
+}
+
+void Compiler::emits(Opcode kind, const char *s, int i, int j) {
+	emit(kind, i);
+	ops.back().j = j;
+	ops.back().u.s = s;
+}
+
+void Compiler::mark(bool quoted) {
+	emit(opMark, quoted);
+	if (++depth > maxdepth)
+		maxdepth = depth;
+}
+
+/* iscount -- is this the call the parser makes for $#var? */
+static bool iscount(Tree *t) {
+	if (t == NULL || t->kind != nList)
+		return false;
+	Tree *fn = t->u[0].p, *args = t->u[1].p;
+	return fn->kind == nWord && streq(fn->u[0].s, "%count")
+	    && args != NULL && args->u[1].p == NULL
+	    && args->u[0].p->kind == nVar;
+}
+
+/* var -- append the value of a variable */
+void Compiler::var(Tree *name) {
+	int d, slot;
+	if ((name->kind == nWord || name->kind == nQword)
+	    && *name->u[0].s != '\0'
+	    /* $1 and friends are looked up through $* */
+	    && !(isdigit(*name->u[0].s) && !streq(name->u[0].s, "0"))) {
+		const char *s = name->u[0].s;
+		if (resolve(scope, s, &d, &slot))
+			emits(opLexical, s, d, slot);
+		else {
+			emit(opLookup, d);
+			ops.back().u.sym = intern(s);
+		}
+		return;
+	}
+	list(name, false);
+	emit(opVar);
+	pop(1);
+}
+
+/* literal -- is this a word whose value needs no globbing? */
+static bool literal(Tree *t, bool quoted, bool exact) {
+	return t != NULL
+	    && (t->kind == nQword
+		|| (t->kind == nWord && (!quoted || (!t->glob && !exact))));
+}
+
+/* literals -- emit a run of literal words as one list; return the rest */
+Tree *Compiler::literals(Tree *tree, bool quoted) {
+	std::vector< Term *, gc_allocator<Term *> > terms;
+	for (; tree != NULL; tree = tree->u[1].p) {
+		Tree *t = (tree->kind == nList) ? tree->u[0].p : tree;
+		if (!literal(t, quoted, exact))
+			break;
+		terms.push_back(mkstr(t->u[0].s));
+		if (tree->kind != nList) {
+			tree = NULL;
+			break;
+		}
+	}
+	emit(opLiteral);
+	ops.back().u.list = mklists(&terms[0], terms.size(), NULL);
+	return tree;
+}
+
+/* words -- append the values of a tree to the frame on top */
+void Compiler::words(Tree *tree, bool quoted) {
+	while (tree != NULL) {
+		if (literal(tree->kind == nList ? tree->u[0].p : tree,
+			    quoted, exact)) {
+			tree = literals(tree, quoted);
+			continue;
+		}
+		switch (tree->kind) {
+		case nWord:
+			emit(opWord);
+			ops.back().u.list = mkstrcell(tree->u[0].s, NULL);
+			return;
+		case nPrim:
+			emit(opPrim, 0, tree);
+			return;
+		case nThunk: case nLambda:
+			emit(opClosure, 0, tree, bodycode(tree, scope));
+			return;
+		case nVar:
+			var(tree->u[0].p);
+			return;
+		case nVarsub: {
+			Tree *name = tree->u[0].p;
+			if (name != NULL
+			    && (name->kind == nWord || name->kind == nQword)) {
+				mark(false);
+				var(name);
+			} else {
+				list(name, false);
+				emit(opVarname);
+			}
+			list(tree->u[1].p, false);
+			emit(opSubscript);
+			pop(2);
+			return;
+		}
+		case nArith:
+			emit(opArith);
+			ops.back().u.arith = arith(tree, scope);
+			return;
+		case nCall: {
+			/* <={...} runs the body in place rather than
+			   building a closure only to evaluate it */
+			Tree *t = tree->u[0].p;
+			if (iscount(t)) {
+				mark(false);
+				var(t->u[1].p->u[0].p->u[0].p);
+				emit(opCount);
+				pop(1);
+				return;
+			}
+			emit(opCall, 0, t, (t != NULL && t->kind == nThunk)
+						? compile(t->u[0].p, scope)
+						: compile(t, scope));
+			return;
+		}
+		case nList:
+			words(tree->u[0].p, quoted);
+			tree = tree->u[1].p;
+			break;
+		case nConcat: {
+			/* both sides are quoted if either might glob, and
+			   their words stay raw throughout, because a ] or -
+			   on one side can end a class begun on the other */
+			bool outer = exact;
+			quoted = quoted && (exact || tree->glob);
+			exact = quoted;
+			mark(quoted);
+			words(tree->u[0].p, quoted);
+			mark(quoted);
+			words(tree->u[1].p, quoted);
+			exact = outer;
+			emit(opConcat);
+			pop(2);
+			return;
+		}
+		default:
+			panic("compile: bad node kind %d", tree->kind);
+		}
+	}
+}
+
+/* list -- open a frame and fill it with the values of a tree; the frame
+   is only quoted (and later globbed) if the words might need it */
+void Compiler::list(Tree *tree, bool quoted) {
+	quoted = quoted && tree != NULL && tree->glob;
+	mark(quoted);
+	words(tree, quoted);
+}
+
+/* bindings -- compile the (name = value) pairs of let, local, and for */
+void Compiler::bindings(Tree *defn, Opcode bind) {
+	for (; defn != NULL; defn = defn->u[1].p) {
+		assert(defn->kind == nList);
+		if (defn->u[0].p == NULL)
+			continue;
+		Tree *assign = defn->u[0].p;
+		assert(assign->kind == nAssign);
+		list(assign->u[0].p, false);
+		list(assign->u[1].p, true);
+		emit(bind);
+		pop(2);
+	}
+}
+
+/* command -- compile a command; always ends the code */
+void Compiler::command(Tree *tree) {
+top:
+	if (tree == NULL) {
+		emit(opTrue);
+		return;
+	}
+
+	switch (tree->kind) {
+	case nConcat: case nList: case nQword: case nVar: case nVarsub:
+	case nWord: case nThunk: case nLambda: case nCall: case nPrim:
+		list(tree, true);
+		emit(opEval);
+		pop(1);
+		return;
+
+	case nAssign: {
+		Tree *name = tree->u[0].p;
+		int d, slot;
+		if ((name->kind == nWord || name->kind == nQword)
+		    && resolve(scope, name->u[0].s, &d, &slot)) {
+			list(tree->u[1].p, true);
+			emits(opSetlexical, name->u[0].s, d, slot);
+			pop(1);
+			return;
+		}
+		list(name, false);
+		list(tree->u[1].p, true);
+		emit(opAssign);
+		pop(2);
+		return;
+	}
+
+	case nLet: case nClosure: {
+		lets.push_back(Scope());
+		Scope *inner = &lets.back();
+		inner->opaque = !defnnames(tree->u[0].p, inner->names);
+		inner->next = scope;
+		emit(opBindings, 0);
+		ops.back().j = inner->opaque ? -1 : inner->names.size();
+		bindings(tree->u[0].p, opBind);
+		emit(opEnter);
+		if (inner->opaque || !inner->names.empty())
+			scope = inner;
+		tree = tree->u[1].p;
+		goto top;
+	}
+
+	case nLocal:
+		emit(opBindings, 1);
+		ops.back().j = -1;
+		bindings(tree->u[0].p, opBind);
+		emit(opLocal, 0, NULL, compile(tree->u[1].p, scope));
+		return;
+
+	case nFor: {
+		Scope inner;
+		inner.opaque = !defnnames(tree->u[0].p, inner.names);
+		inner.next = scope;
+		emit(opBindings, 1);
+		ops.back().j = -1;
+		bindings(tree->u[0].p, opForbind);
+		emit(opFor, 0, NULL,
+		     compile(tree->u[1].p,
+			     inner.opaque || !inner.names.empty() ? &inner : scope));
+		return;
+	}
+
+	case nMatch: case nExtract:
+		list(tree->u[0].p, true);
+		/* patterns always carry their quoting, for the matcher */
+		mark(true);
+		words(tree->u[1].p, true);
+		emit(tree->kind == nMatch ? opMatch : opExtract);
+		pop(2);
+		return;
+
+	default:
+		panic("compile: bad node kind %d", tree->kind);
+	}
+}
+
+/* result -- compile a list of words whose value is the result */
+void Compiler::result(Tree *tree) {
+	list(tree, true);
+	emit(opResult);
+	pop(1);
+}
+
+Code *Compiler::finish() {
+	assert(depth == 0);
+	Code *code = gcnew(Code);
+	code->nops = ops.size();
+	code->depth = maxdepth;
+	code->ops = reinterpret_cast<Op *>(galloc(ops.size() * sizeof (Op)));
+	std::copy(ops.begin(), ops.end(), code->ops);
+	return code;
+}
+
+
+/*
+ * arithmetic
+ *	expressions are compiled in postfix order.  an operator whose
+ *	operands are all constants is applied on the spot, so a constant
+ *	subexpression leaves a single aConst behind.
+ */
+
+class ArithCompiler {
+public:
+	ArithCompiler(Scope *scope) : depth(0), maxdepth(0), scope(scope) {}
+	void expr(Tree *tree);
+	Arith *finish(Tree *tree);
+private:
+	Aop &push(Arithop kind);
+	void literal(Tree *tree);
+	void var(Tree *name, bool count);
+	void op(Arithop kind, int arity);
+
+	std::vector< Aop, gc_allocator<Aop> > ops;
+	int depth, maxdepth;
+	Scope *scope;
+};
+
+Aop &ArithCompiler::push(Arithop kind) {
+	Aop op;
+	memzero(&op, sizeof op);
+	op.kind = kind;
+	ops.push_back(op);
+	if (++depth > maxdepth)
+		maxdepth = depth;
+	return ops.back();
+}
+
+/* literal -- read a number now; a bad one fails only if it is reached */
+void ArithCompiler::literal(Tree *tree) {
+	const char *s = tree->u[0].s;
+	char *end = NULL;
+	errno = 0;
+	if (tree->kind == nInt) {
+		long long i = strtoll(s, &end, 10);
+		if (errno == 0 && end != s && *end == '\0') {
+			Aop &op = push(aConst);
+			op.u.n.type = num_int;
+			op.u.n.u.i = i;
+			return;
+		}
+		push(aBad).u.s = "Could not handle integer input";
+	} else {
+		double d = strtod(s, &end);
+		if (errno != EINVAL && end != s && *end == '\0') {
+			Aop &op = push(aConst);
+			op.u.n.type = num_float;
+			op.u.n.u.d = d;
+			return;
+		}
+		push(aBad).u.s = "Could not handle floating point input";
+	}
+}
+
+/* var -- push the value or length of a variable */
+void ArithCompiler::var(Tree *name, bool count) {
+	assert(name->kind == nWord);
+	const char *s = name->u[0].s;
+	int d, slot;
+	if (isdigit(*s) && !streq(s, "0")) {
+		Aop &op = push(aName);
+		op.u.s = s;
+		op.count = count;
+	} else if (resolve(scope, s, &d, &slot)) {
+		Aop &op = push(aLexical);
+		op.i = d;
+		op.j = slot;
+		op.u.s = s;
+		op.count = count;
+	} else {
+		Aop &op = push(aLookup);
+		op.i = d;
+		op.u.sym = intern(s);
+		op.count = count;
+	}
+}
+
+/* op -- apply an operator to the top arity numbers, folding constants */
+void ArithCompiler::op(Arithop kind, int arity) {
+	int n = ops.size();
+	if (ops[n - 1].kind == aConst
+	    && (arity == 1 || ops[n - 2].kind == aConst)) {
+		Number a = ops[n - arity].u.n, b = ops[n - 1].u.n;
+		ops.resize(n - arity);
+		depth -= arity;
+		push(aConst).u.n = arithop(kind, a, b);
+		return;
+	}
+	Aop op;
+	memzero(&op, sizeof op);
+	op.kind = kind;
+	ops.push_back(op);
+	depth -= arity - 1;
+}
+
+void ArithCompiler::expr(Tree *tree) {
+	Arithop kind;
+	switch (tree->kind) {
+	case nInt: case nFloat:
+		literal(tree);
+		return;
+	case nVar:
+		var(tree->u[0].p, false);
+		return;
+	case nCount:
+		var(tree->u[0].p, true);
+		return;
+	case nNegate:
+		expr(tree->u[0].p);
+		op(aNegate, 1);
+		return;
+	case nPlus:		kind = aPlus;		break;
+	case nMinus:		kind = aMinus;		break;
+	case nMult:		kind = aMult;		break;
+	case nDivide:		kind = aDivide;		break;
+	case nModulus:		kind = aModulus;	break;
+	case nPow:		kind = aPow;		break;
+	case nLess:		kind = aLess;		break;
+	case nLessEqual:	kind = aLessEqual;	break;
+	case nGreater:		kind = aGreater;	break;
+	case nGreaterEqual:	kind = aGreaterEqual;	break;
+	case nEqual:		kind = aEqual;		break;
+	case nNotEqual:		kind = aNotEqual;	break;
+	default:
+		panic("arith: bad node kind %d", tree->kind);
+	}
+	expr(tree->u[0].p);
+	expr(tree->u[1].p);
+	op(kind, 2);
+}
+
+Arith *ArithCompiler::finish(Tree *tree) {
+	assert(depth == 1);
+	Arith *arith = gcnew(Arith);
+	arith->nops = ops.size();
+	arith->depth = maxdepth;
+	arith->ops = reinterpret_cast<Aop *>(galloc(ops.size() * sizeof (Aop)));
+	std::copy(ops.begin(), ops.end(), arith->ops);
+	arith->tree = tree;
+	return arith;
+}
+
+/* arith -- compile an nArith tree */
+static Arith *arith(Tree *tree, Scope *scope) {
+	ArithCompiler c(scope);
+	c.expr(tree->u[0].p);
+	return c.finish(tree);
+}
+
+
+/*
+ * entry points
+ */
+
+/* compile -- compile a command */
+static Code *compile(Tree *tree, Scope *scope) {
+	Compiler c(scope);
+	c.command(tree);
+	return c.finish();
+}
+
+/* bodycode -- compile the body of a closure tree */
+static Code *bodycode(Tree *tree, Scope *scope) {
+	switch (tree->kind) {
+	case nThunk:
+		return compile(tree->u[0].p, scope);
+	case nLambda: {
+		Scope params;
+		params.opaque = false;
+		params.next = scope;
+		literalnames(tree->u[0].p, params.names);
+		return compile(tree->u[1].p,
+			       params.names.empty() ? scope : &params);
+	}
+	case nList: {
+		/* a closure over a plain list of words */
+		Compiler c(scope);
+		c.result(tree);
+		return c.finish();
+	}
+	default:
+		panic("bodycode: bad closure node kind %d", tree->kind);
+	}
+}
+
+/* closurecode -- the compiled body of a closure, compiling it if needed */
+extern Code *closurecode(Closure *closure) {
+	if (closure->code == NULL)
+		closure->code = bodycode(closure->tree,
+					 closure->binding == NULL
+						? NULL
+						: &opaquescope);
+	return closure->code;
+}
+
+
+/*
+ * disassembly
+ */
+
+static const char *opname(Opcode kind) {
+	switch (kind) {
+	case opMark:		return "mark";
+	case opWord:		return "word";
+	case opLiteral:		return "literal";
+	case opPrim:		return "prim";
+	case opClosure:		return "closure";
+	case opVar:		return "var";
+	case opLexical:		return "lexical";
+	case opLookup:		return "lookup";
+	case opVarname:		return "varname";
+	case opSubscript:	return "subscript";
+	case opConcat:		return "concat";
+	case opArith:		return "arith";
+	case opCall:		return "call";
+	case opCount:		return "count";
+	case opBindings:	return "bindings";
+	case opBind:		return "bind";
+	case opForbind:		return "forbind";
+	case opEnter:		return "enter";
+	case opLocal:		return "local";
+	case opFor:		return "for";
+	case opTrue:		return "true";
+	case opEval:		return "eval";
+	case opAssign:		return "assign";
+	case opSetlexical:	return "setlexical";
+	case opMatch:		return "match";
+	case opExtract:		return "extract";
+	case opResult:		return "result";
+	default:		panic("opname: bad opcode %d", kind);
+	}
+}
+
+/* disarith -- print an arithmetic program in postfix */
+static void disarith(Arith *arith) {
+	static const char *const opnames[] = {
+		"neg", "+", "-", "*", "/", "%", "**",
+		"<", "<=", ">", ">=", "==", "!="
+	};
+	for (int n = 0; n < arith->nops; n++) {
+		Aop *op = &arith->ops[n];
+		switch (op->kind) {
+		case aConst:
+			if (op->u.n.type == num_int)
+				print(" %lld", (long long) op->u.n.u.i);
+			else
+				print(" %s", getstr(mkfloat(op->u.n.u.d)));
+			break;
+		case aLexical: case aName:
+			print(" $%s%s", op->count ? "#" : "", op->u.s);
+			break;
+		case aLookup:
+			print(" $%s%s", op->count ? "#" : "", op->u.sym->name);
+			break;
+		case aBad:
+			print(" error");
+			break;
+		default:
+			print(" %s", opnames[op->kind - aNegate]);
+			break;
+		}
+	}
+}
+
+/* disassemble -- print code, with nested code indented below its op */
+static void disassemble(Code *code, const char *indent) {
+	for (int n = 0; n < code->nops; n++) {
+		Op *op = &code->ops[n];
+		print("%s%4d  %-10s", indent, n, opname(op->kind));
+		switch (op->kind) {
+		case opMark:
+			if (op->i)
+				print(" quoted");
+			break;
+		case opWord:
+			print(" %S", getstr(op->u.list->term));
+			break;
+		case opLiteral:
+			for (List *lp = op->u.list; lp != NULL; lp = lp->next)
+				print(" %S", getstr(lp->term));
+			break;
+		case opLexical: case opSetlexical:
+			print(" %S (%d, %d)", op->u.s, op->i, op->j);
+			break;
+		case opLookup:
+			if (op->i < 0)
+				print(" %S global", op->u.sym->name);
+			else
+				print(" %S past %d", op->u.sym->name, op->i);
+			break;
+		case opPrim: case opClosure:
+			print(" %T", op->u.t);
+			break;
+		case opArith:
+			print(" %T =", op->u.arith->tree);
+			disarith(op->u.arith);
+			break;
+		case opBindings:
+			print(op->i ? " empty" : " inherited");
+			if (op->j >= 0)
+				print(" frame %d", op->j);
+			break;
+		default:
+			break;
+		}
+		print("\n");
+		if (op->body != NULL)
+			disassemble(op->body, str("%s\t", indent));
+	}
+}
+
+PRIM(disassemble) {
+	(void)evalflags;
+	if (list == NULL || list->next != NULL)
+		fail("$&disassemble", "usage: $&disassemble function");
+	Closure *closure = getclosure(list->term);
+	if (closure == NULL) {
+		const char *name = getstr(list->term);
+		List *fn = varlookup2("fn-", name, binding);
+		if (fn == NULL || fn->next != NULL
+		    || (closure = getclosure(fn->term)) == NULL)
+			fail("$&disassemble", "%s: not a function", name);
+	}
+	print("%C\n", closure);
+	if (closure->tree->kind != nPrim)
+		disassemble(closurecode(closure), "");
+	return ltrue;
+}
+
+extern void initprims_compile(Prim_dict& primdict) {
+	X(disassemble);
+}
@@ -57,6 +57,10 @@ static std::string arith_dump(Tree *expr) {
 		case nVar:
 			// FIXME: Should look similar to nVar code in Tconv
 			return str("$%s", expr->u[0].p->u[0].s);
+		case nCount:
+			return str("$#%s", expr->u[0].p->u[0].s);
+		case nNegate:
+			return "(-" + arith_dump(expr->u[0].p) + ")";
 		case nPlus:
 			sep = "+";
 			break;
@@ -75,6 +79,24 @@ static std::string arith_dump(Tree *expr) {
 		case nPow:
 			sep = "**";
 			break;
+		case nLess:
+			sep = "<";
+			break;
+		case nLessEqual:
+			sep = "<=";
+			break;
+		case nGreater:
+			sep = ">";
+			break;
+		case nGreaterEqual:
+			sep = ">=";
+			break;
+		case nEqual:
+			sep = "==";
+			break;
+		case nNotEqual:
+			sep = "!=";
+			break;
 		default:
 			panic("unknown node kind in arithmetic expression: %d",
 				expr->kind);
@@ -272,7 +294,7 @@ static bool Cconv(Format *f) {
 #endif
 
 	if (altform)
-		fmtprint(f, "%S", str("%C", closure));
+		fmtprint(f, "%S", closuretext(closure));
 	else {
 		if (binding != NULL) {
 			fmtprint(f, "%%closure(");
@@ -0,0 +1,83 @@
+/* dict.cxx -- hash table of global names */
+
+#include "xs.hxx"
+#include "var.hxx"
+
+/* lookup -- find the symbol for a name, or NULL */
+Symbol *Dict::lookup(const char *name) {
+	if (size == 0)
+		return NULL;
+	unsigned long hash = strhash(name), mask = size - 1;
+	for (unsigned long i = hash & mask;; i = (i + 1) & mask) {
+		Slot *slot = &slots[i];
+		if (slot->sym == NULL)
+			return NULL;
+		if (slot->hash == hash && streq(slot->sym->name, name))
+			return slot->sym;
+	}
+}
+
+/* intern -- find the symbol for a name, creating it if needed */
+Symbol *Dict::intern(const char *name) {
+	if (2 * (count + 1) > size)
+		grow();
+	unsigned long hash = strhash(name), mask = size - 1;
+	unsigned long i = hash & mask;
+	for (;; i = (i + 1) & mask) {
+		Slot *slot = &slots[i];
+		if (slot->sym == NULL)
+			break;
+		if (slot->hash == hash && streq(slot->sym->name, name))
+			return slot->sym;
+	}
+
+	Symbol *sym = gcnew(Symbol);
+	sym->name = gcdup(name);
+	sym->var = NULL;
+	sym->fn = sym->set = NULL;
+	sym->noexport = false;
+	sym->envqueued = false;
+	slots[i].hash = hash;
+	slots[i].sym = sym;
+	++count;
+	return sym;
+}
+
+/* grow -- double the table, rehashing from the stored hashes */
+void Dict::grow() {
+	unsigned long oldsize = size;
+	Slot *old = slots;
+	size = (oldsize == 0) ? 1024 : oldsize * 2;
+	slots = reinterpret_cast<Slot *>(galloc(size * sizeof (Slot)));
+	memzero(slots, size * sizeof (Slot));
+	unsigned long mask = size - 1;
+	for (unsigned long i = 0; i < oldsize; i++)
+		if (old[i].sym != NULL) {
+			unsigned long j = old[i].hash & mask;
+			while (slots[j].sym != NULL)
+				j = (j + 1) & mask;
+			slots[j] = old[i];
+		}
+}
+
+/* skip -- advance an iterator to a symbol that is set */
+void Dict::iterator::skip() {
+	for (; i < dict->size; i++) {
+		Symbol *sym = dict->slots[i].sym;
+		if (sym != NULL && sym->var != NULL)
+			return;
+	}
+}
+
+static bool symlt(Symbol *a, Symbol *b) {
+	return strcmp(a->name, b->name) < 0;
+}
+
+/* sorted -- the symbols that are set, ordered by name */
+Dict::Symbols Dict::sorted() {
+	Symbols result;
+	foreach (Symbol *sym, *this)
+		result.push_back(sym);
+	std::sort(result.begin(), result.end(), symlt);
+	return result;
+}
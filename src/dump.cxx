@@ -120,7 +120,15 @@ static const char *nodename(NodeKind k) {
 	case nModulus:	return "Modulus";
 	case nPow:	return "Power";
 	case nInt:	return "Int";
-	case nFloat:	return "Flat";
+	case nFloat:	return "Float";
+	case nNegate:	return "Negate";
+	case nCount:	return "Count";
+	case nLess:	return "Less";
+	case nLessEqual: return "LessEqual";
+	case nGreater:	return "Greater";
+	case nGreaterEqual: return "GreaterEqual";
+	case nEqual:	return "Equal";
+	case nNotEqual:	return "NotEqual";
 	default:	panic("nodename: bad node kind %d", k);
 	}
 }
@@ -135,24 +143,30 @@ static const char *dumptree(Tree *tree) {
 			panic("dumptree: bad node kind %d", tree->kind);
 		    case nWord: case nQword: case nPrim:
 		    case nInt: case nFloat:
-			print("static Tree_s %s = { n%s, { { %s } } };\n",
+			print("static Tree_s %s = { n%s, %s, { { %s } } };\n",
 			      name + 1, nodename(tree->kind),
+			      tree->glob ? "true" : "false",
                               dumpstring(tree->u[0].s));
 			break;
 		    case nCall: case nThunk: case nVar: case nArith:
-			print("static Tree_p %s = { n%s, { { (Tree *) %s }"
+		    case nNegate: case nCount:
+			print("static Tree_p %s = { n%s, %s, { { (Tree *) %s }"
 			      " } };\n",
 			      name + 1, nodename(tree->kind),
+			      tree->glob ? "true" : "false",
                               dumptree(tree->u[0].p));
 			break;
 		    case nPlus: case nMinus: case nMult: case nDivide:
-		    case nModulus: case nPow: case nAssign: case nConcat:
+		    case nModulus: case nPow: case nLess: case nLessEqual:
+		    case nGreater: case nGreaterEqual: case nEqual:
+		    case nNotEqual: case nAssign: case nConcat:
 		    case nClosure: case nFor: case nLambda: case nLet:
 		    case nList: case nLocal: case nVarsub: case nMatch:
 		    case nExtract:
-			print("static Tree_pp %s = { n%s, { { (Tree *) %s },"
+			print("static Tree_pp %s = { n%s, %s, { { (Tree *) %s },"
                               " { (Tree *) %s } } };\n",
 			      name + 1, nodename(tree->kind),
+			      tree->glob ? "true" : "false",
                               dumptree(tree->u[0].p), dumptree(tree->u[1].p));
 		}
 		cvars.insert(name);
@@ -167,7 +181,7 @@ static const char *dumpbinding(Binding *binding) {
 	name = str("&B_%ulx", (long long) binding);
 	if (cvars.count(name) == 0) {
 		print(
-			"static Binding %s = { %s, %s, %s };\n",
+			"static Binding %s = { %s, %s, %s, 0, 0 };\n",
 			name + 1,
 			dumpstring(binding->name),
 			dumplist(binding->defn),
@@ -184,7 +198,7 @@ static const char *dumpclosure(Closure *closure) {
 	const char *name = str("&C_%ulx",  (long long) closure);
 	if (cvars.count(name) == 0) {
 		print(
-			"static Closure %s = { (Binding *) %s, (Tree *) %s };\n",
+			"static Closure %s = { (Binding *) %s, (Tree *) %s, (Code *) NULL, NULL, 0 };\n",
 			name + 1,
 			dumpbinding(closure->binding),
 			dumptree(closure->tree)
@@ -200,9 +214,9 @@ static const char *dumpterm(Term *term) {
 	const char *name = str("&E_%ulx", (long long) term);
 	if (cvars.count(name) == 0) {
 		print(
-			"static Term %s = { %s, (Closure *) %s };\n",
+			"static Term %s = { %s, (Closure *) %s, num_none, { 0 } };\n",
 			name + 1,
-			dumpstring(term->str),
+			dumpstring(term->closure == NULL ? getstr(term) : NULL),
 			dumpclosure(term->closure)
 		);
 		cvars.insert(name);
@@ -216,7 +230,7 @@ static const char *dumplist(List *list) {
 	const char *name = str("&L_%ulx", (long long) list);
 	if (cvars.count(name) == 0) {
 		print(
-			"static List %s = { %s, %s };\n",
+			"static List %s = { %s, %s, 1 };\n",
 			name + 1,
 			dumpterm(list->term),
 			dumplist(list->next)
@@ -252,9 +266,9 @@ static void dumpvariables(const char *key, Var *value) {
 }
 
 #define TreeTypes \
-	typedef struct { NodeKind k; struct { const char *s; } u[1]; } Tree_s; \
-	typedef struct { NodeKind k; struct { Tree *p; } u[1]; } Tree_p; \
-	typedef struct { NodeKind k; struct { Tree *p; } u[2]; } Tree_pp;
+	typedef struct { NodeKind k; bool g; struct { const char *s; } u[1]; } Tree_s; \
+	typedef struct { NodeKind k; bool g; struct { Tree *p; } u[1]; } Tree_p; \
+	typedef struct { NodeKind k; bool g; struct { Tree *p; } u[2]; } Tree_pp;
 TreeTypes
 #define	PPSTRING(s)	STRING(s)
 
@@ -280,18 +294,15 @@ extern void runinitial(void) {
 	const List *title = runfd(0, "initial.xs", 0);
 
 	printheader(title);
-	foreach (Dict::value_type var, vars) dumpvar(var.first.c_str(),
-		 var.second);
+	Dict::Symbols syms = vars.sorted();
+	foreach (Symbol *sym, syms) dumpvar(sym->name, sym->var);
 
 	/* these must be assigned in this order, or things just won't work */
 	varbuf << "\nstatic const struct { const char *name; List *value; }"
 		  " defs[] = {\n";
-	foreach (Dict::value_type var, vars) dumpfunctions(var.first.c_str(),
-		 var.second);
-	foreach (Dict::value_type var, vars) dumpsettors(var.first.c_str(),
-		 var.second);
-	foreach (Dict::value_type var, vars) dumpvariables(var.first.c_str(),
-		 var.second);
+	foreach (Symbol *sym, syms) dumpfunctions(sym->name, sym->var);
+	foreach (Symbol *sym, syms) dumpsettors(sym->name, sym->var);
+	foreach (Symbol *sym, syms) dumpvariables(sym->name, sym->var);
 	varbuf << "\t{ NULL, NULL }\n"
 		  "};\n\n";
 	print(varbuf.str().c_str());
@@ -1,11 +1,14 @@
 /* eval.cxx -- evaluation of lists and trees */
 
 #include "xs.hxx"
+#include "code.hxx"
+#include <alloca.h>
+#include <new>
 #include <string>
 #include <term.hxx>
 unsigned long evaldepth = 0, maxevaldepth = MAXmaxevaldepth;
 
-List safe_exit = {};
+List safe_exit = { NULL, NULL, 1 };
 
 static List *mksafe(List * l, bool needed) {
 	if (!needed) {
@@ -32,7 +35,7 @@ static void failexec(const char* file, const List* args) {
 	fn = varlookup("fn-%exec-failure", NULL);
 	if (fn != NULL) {
 		int olderror = errno;
-		const List* list = append(fn, mklist(mkstr(file),
+		const List* list = append(fn, mkstrcell(file,
                                           const_cast<List*>(args)));
 		
 		eval(list, NULL, 0);
@@ -42,13 +45,16 @@ static void failexec(const char* file, const List* args) {
 	exit(1);
 }
 
-/* forkexec -- fork (if necessary) and exec */
+/* forkexec -- fork (if necessary) and exec; spawn if that's all it takes */
 extern List *forkexec(const char *file, const List *list, bool inchild) {
 	Vector *env = mkenv();
 	Vector *args = vectorize(list);
-//	char **args;
 
-	int pid = efork(!inchild, false);
+	/* if the spawn fails, fork anyway: the child runs %exec-failure
+	   and reports the error just as it always has */
+	int pid = inchild ? -1 : espawn(file, &(*args)[0], &(*env)[0]);
+	if (pid == -1)
+		pid = efork(!inchild, false);
 	if (pid == 0) {
 		execve(file, &(*args)[0], &(*env)[0]);
 		failexec(file, list);
@@ -62,7 +68,7 @@ extern List *forkexec(const char *file, const List *list, bool inchild) {
 	} else
 		SIGCHK();
 	printstatus(0, status);
-	return mklist(mkterm(mkstatus(status), NULL), NULL);
+	return mktermcell(mkstatus(status), NULL, NULL);
 }
 
 /* Sets each value to each values, with proper semantics for things like 
@@ -79,13 +85,10 @@ static void assign_helper(List*& value, List*& values, void *vars) {
 }
 
 /* assign -- bind a list of values to a list of variables */
-static List *assign(Tree* varform, Tree* valueform, Binding* binding) {
-	List* vars = glom(varform, binding, false);
-
+static List *assign(List* vars, List* values, Binding* binding) {
 	if (vars == NULL)
 		fail("xs:assign", "null variable name");
 
-	List* values = glom(valueform, binding, true);
 	List* result = values;
 
 	List* value;
@@ -99,42 +102,52 @@ static List *assign(Tree* varform, Tree* valueform, Binding* binding) {
 	return result;
 }
 
-/* letbindings -- create a new Binding containing let-bound (lexical) variables */
-static Binding *letbindings(Tree* defn, Binding* binding,
-				Binding* context,
-				int __attribute__((unused)) evalflags) {
-	Tree* assign;
-	List *vars, *values, *value;
+/* letbindings -- add let-bound (lexical) variables to a new Binding,
+   filling the cells of a frame from cell onwards if there is one */
+static Binding *letbindings(List* vars, List* values, Binding* binding,
+			    Binding* cell) {
+	List* value;
 	const char* name;
 
-	for (; defn != NULL; defn = defn->u[1].p) {
-		assert(defn->kind == nList);
-		if (defn->u[0].p == NULL)
-			continue;
-
-		assign = defn->u[0].p;
-		assert(assign->kind == nAssign);
-		vars = glom(assign->u[0].p, context, false);
-		values = glom(assign->u[1].p, context, true);
-
-		if (vars == NULL)
-			fail("xs:letbindings", "null variable name");
+	if (vars == NULL)
+		fail("xs:letbindings", "null variable name");
 
-		for (; vars != NULL; vars = vars->next) {
-			name = getstr(vars->term);
-			assign_helper(value, values, vars->next);
+	for (; vars != NULL; vars = vars->next) {
+		name = getstr(vars->term);
+		assign_helper(value, values, vars->next);
+		if (cell == NULL)
 			binding = mkbinding(name, value, binding);
+		else {
+			validatevar(name);
+			cell->name = name;
+			cell->defn = value;
+			binding = cell++;
 		}
 	}
 
 	return binding;
 }
 
+static List MULTIPLE = { NULL, NULL, 1 };
+
+/* forbindings -- add the variables of one for loop clause */
+static Binding *forbindings(List* vars, List* list, Binding* looping) {
+	if (vars == NULL)
+		fail("xs:forloop", "null variable name");
+	for (; vars != NULL; vars = vars->next) {
+		const char* var = getstr(vars->term);
+		looping = mkbinding(var, list, looping);
+		list = &MULTIPLE;
+	}
+	SIGCHK();
+	return looping;
+}
+
 /* localbind -- recursively convert a Bindings list into dynamic binding */
 static const List *localbind(Binding* dynamic, Binding* lexical,
-			   Tree* body, int evalflags) {
+			   Code* body, int evalflags) {
 	if (!dynamic)
-		return walk(body, lexical, evalflags);
+		return execute(body, lexical, evalflags);
 	else {
 		Dyvar p(dynamic->name, dynamic->defn);
 		return localbind(dynamic->next, lexical, body, evalflags);
@@ -142,37 +155,19 @@ static const List *localbind(Binding* dynamic, Binding* lexical,
 }
 
 /* local -- build, recursively, one layer of local assignment */
-const static List *local(Tree *defn, Tree* body,
+const static List *local(Binding *defn, Code* body,
 		   Binding* bindings, int evalflags) {
-	Binding* dynamic =
-		reversebindings(letbindings(defn, NULL, bindings, evalflags));
+	Binding* dynamic = reversebindings(defn);
 	return localbind(dynamic, bindings, body, evalflags);
 }
 
 /* forloop -- evaluate a for loop */
-const static List *forloop(Tree* defn, Tree* body,
+const static List *forloop(Binding* looping, Code* body,
 			 Binding* outer, int evalflags) {
-	static List MULTIPLE = { NULL, NULL };
-
-	Binding* looping = NULL;
-	for (; defn != NULL; defn = defn->u[1].p) {
-		assert(defn->kind == nList);
-		if (defn->u[0].p == NULL)
-			continue;
-		Tree* assign = defn->u[0].p;
-		assert(assign->kind == nAssign);
-		List* vars = glom(assign->u[0].p, outer, false);
-		List* list = glom(assign->u[1].p, outer, true);
-		if (vars == NULL)
-			fail("xs:forloop", "null variable name");
-		for (; vars != NULL; vars = vars->next) {
-			const char* var = getstr(vars->term);
-			looping = mkbinding(var, list, looping);
-			list = &MULTIPLE;
-		}
-		SIGCHK();
-	}
 	looping = reversebindings(looping);
+	int n = 0;
+	for (Binding *lp = looping; lp != NULL; lp = lp->next)
+		++n;
 
 	bool allnull;
 	Binding *bp, *lp, *sequence; 
@@ -182,10 +177,10 @@ const static List *forloop(Tree* defn, Tree* body,
 	try {
 		for (;;) {
 			allnull = true;
-			bp = outer;
+			bp = mkframe(n, outer);
 			lp = looping;
 			sequence = NULL;
-			for (; lp != NULL; lp = lp->next) {
+			for (; lp != NULL; lp = lp->next, bp++) {
 				value = NULL;
 				if (lp->defn != &MULTIPLE)
 					sequence = lp;
@@ -196,12 +191,14 @@ const static List *forloop(Tree* defn, Tree* body,
 					sequence->defn = sequence->defn->next;
 					allnull = false;
 				}
-				bp = mkbinding(lp->name, value, bp);
+				bp->name = lp->name;
+				bp->defn = value;
 			}
 			if (allnull) {
 				break;
 			}
-			result = walk(body, bp, evalflags & eval_exitonfalse);
+			--bp;
+			result = execute(body, bp, evalflags & eval_exitonfalse);
 			SIGCHK();
 		}
 	} catch (List *e) {
@@ -212,69 +209,319 @@ const static List *forloop(Tree* defn, Tree* body,
 	return result;
 }
 
-/* matchpattern -- does the text match a pattern? */
-static const List *matchpattern(Tree* subjectform, Tree* patternform,
-			  Binding* binding) {
-	StrList *quote = NULL;
-	List* subject = glom(subjectform, binding, true);
-	List* pattern = glom2(patternform, binding, &quote);
-	return listmatch(subject, pattern, quote) 
-		? ltrue 
-		: lfalse;
+/*
+ * the frame stack
+ *	each frame is a list under construction.  frames opened for
+ *	words that may be globbed or used as patterns also keep a list
+ *	of quote flags, one per word, as glob() and match() expect.
+ *
+ *	lists are never changed once built, so the value of a variable
+ *	or of a call is not copied when it is the last thing in a frame:
+ *	it is kept aside as the frame's shared tail and hung off the end
+ *	of the frame's own cells when the frame is used.  it is copied
+ *	only if something follows it, or if its quote flags are needed.
+ */
+
+struct Frame {
+	List *list, **tail;
+	QuoteList *quote, **qtail;
+	List *shared;
+	bool quoted;
+};
+
+static void materialize(Frame *f);
+
+/* add -- append a fresh list to a frame, all with the same quoting */
+static void add(Frame *f, List *list, const Quote *q) {
+	if (list == NULL)
+		return;
+	if (f->shared != NULL)
+		materialize(f);
+	*f->tail = list;
+	for (; list != NULL; list = list->next) {
+		f->tail = &list->next;
+		if (f->quoted) {
+			*f->qtail = mkquotelist(q, NULL);
+			f->qtail = &(*f->qtail)->next;
+		}
+	}
+}
+
+/* share -- append a list that may not be changed to a frame, quoted */
+static void share(Frame *f, List *list) {
+	if (list == NULL)
+		return;
+	if (f->shared != NULL)
+		materialize(f);
+	f->shared = list;
+}
+
+/* materialize -- replace the shared tail of a frame by a copy */
+static void materialize(Frame *f) {
+	List *list = f->shared;
+	f->shared = NULL;
+	add(f, listcopy(list), QUOTED);
+}
+
+/* contents -- the list in a frame, ending with its shared tail */
+static List *contents(Frame *f) {
+	if (f->shared != NULL) {
+		*f->tail = f->shared;
+		f->shared = NULL;
+	}
+	return f->list;
+}
+
+/* globbed -- the contents of a frame, globbed if it was quoted */
+static List *globbed(Frame *f) {
+	if (!f->quoted)
+		return contents(f);
+	List *shared = f->shared;
+	f->shared = NULL;
+	List *list = glob(f->list, f->quote);
+	if (shared == NULL)
+		return list;
+	/* the shared tail is all quoted, so glob() need not see it */
+	if (list == NULL)
+		return shared;
+	List *lp = list;
+	while (lp->next != NULL)
+		lp = lp->next;
+	lp->next = shared;
+	return list;
 }
 
-/* extractpattern -- Like matchpattern, but returns matches */
-static List *extractpattern(Tree* subjectform, Tree* patternform,
-				Binding* binding) {
-	StrList *quote = NULL;
-	List* subject = glom(subjectform, binding, true);
-	List* pattern = glom2(patternform, binding, &quote);
-	return extractmatches(subject, pattern, quote);
+/*
+ * tail calls
+ *	when the last thing a closure or a primitive does is to evaluate a
+ *	list, it hands the list back to eval() to run in place instead, so
+ *	calls in tail position neither grow the C stack nor count against
+ *	max-eval-depth.  the list travels in tailcall_list, and tailmarker
+ *	is returned in place of a result.
+ */
+
+static List tailmarker = { NULL, NULL, 1 };
+static const List *tailcall_list;
+static Binding *tailcall_binding;
+
+/* tailcall -- ask eval() to evaluate list, as the result of a primitive */
+extern const List *tailcall(const List *list, Binding *binding) {
+	tailcall_list = list;
+	tailcall_binding = binding;
+	return &tailmarker;
 }
 
-/* walk -- walk through a tree, evaluating nodes */
-extern const List *walk(Tree* tree, Binding* binding, int flags) {
+/* execute -- run compiled code; tail calls are handed to eval() if tail */
+extern const List *execute(Code *code, Binding* binding, int flags, bool tail) {
 	SIGCHK();
 
-top:
-	if (tree == NULL) return ltrue;
+	Frame *frames = reinterpret_cast<Frame *>(
+				alloca(code->depth * sizeof (Frame)));
+	Frame *sp = frames - 1;
+	Binding *pending = NULL, *cell = NULL;
+
+	for (Op *op = code->ops;; op++) {
+		switch (op->kind) {
+		case opMark:
+			++sp;
+			sp->list = NULL;
+			sp->tail = &sp->list;
+			sp->quote = NULL;
+			sp->qtail = &sp->quote;
+			sp->shared = NULL;
+			sp->quoted = op->i;
+			break;
+
+		case opWord:
+			add(sp, mklist(op->u.list->term, NULL), UNQUOTED);
+			break;
+
+		case opLiteral:
+			share(sp, op->u.list);
+			break;
 
-	switch (tree->kind) {
-		case nConcat: case nList: case nQword: case nVar: case nVarsub:
-		case nWord: case nThunk: case nLambda: case nCall: case nPrim: {
-		List* list = glom(tree, binding, true);
-		return eval(list, binding, flags);
+		case opPrim:
+			add(sp, mktermcell(NULL, mkclosure(op->u.t, NULL),
+				       NULL), QUOTED);
+			break;
+
+		case opClosure: {
+			Closure *closure = mkclosure(op->u.t, binding);
+			closure->code = op->body;
+			add(sp, mktermcell(NULL, closure, NULL), QUOTED);
+			break;
 		}
 
-		case nAssign:
-//		return mksafe(assign(tree->u[0].p, tree->u[1].p, binding), !!(flags & eval_exitonfalse)); // TODO make this work
-		if (flags & eval_exitonfalse) {
-			assign(tree->u[0].p, tree->u[1].p, binding);
-			return ltrue;
+		case opVar: {
+			List *var = contents(sp);
+			--sp;
+			for (; var != NULL; var = var->next)
+				share(sp, varlookup(getstr(var->term), binding));
+			break;
 		}
-		return assign(tree->u[0].p, tree->u[1].p, binding);
 
-		case nLet: case nClosure: {
-		binding = letbindings(tree->u[0].p, binding, binding, flags);
-		tree = tree->u[1].p;
+		case opLexical:
+			share(sp, framelookup(binding, op->i, op->j)->defn);
+			break;
+
+		case opLookup:
+			share(sp, varlookup(op->u.sym,
+					    op->i < 0
+						? NULL
+						: frameskip(binding, op->i)));
+			break;
+
+		case opVarname: {
+			List *name = contents(sp);
+			if (name == NULL)
+				fail("xs:glom1", "null variable name in subscript");
+			if (name->next != NULL)
+				fail("xs:glom1",
+				     "multi-word variable name in subscript");
+			sp->list = varlookup(getstr(name->term), binding);
+			break;
 		}
-		goto top;
 
-		case nLocal:
-		return local(tree->u[0].p, tree->u[1].p, binding, flags);
+		case opSubscript: {
+			List *subs = contents(sp);
+			--sp;
+			List *value = contents(sp);
+			--sp;
+			add(sp, subscript(value, subs), QUOTED);
+			break;
+		}
+
+		case opConcat: {
+			Frame *r = sp--, *l = sp--;
+			if (l->quoted) {
+				if (l->shared != NULL)
+					materialize(l);
+				if (r->shared != NULL)
+					materialize(r);
+				if (sp->shared != NULL)
+					materialize(sp);
+				QuoteList *quote = NULL;
+				List *list = qconcat(l->list, r->list,
+						     l->quote, r->quote, &quote);
+				if (list != NULL) {
+					*sp->tail = list;
+					*sp->qtail = quote;
+					for (; list->next != NULL;
+					     list = list->next, quote = quote->next)
+						;
+					sp->tail = &list->next;
+					sp->qtail = &quote->next;
+				}
+			} else
+				add(sp, concat(contents(l), contents(r)), QUOTED);
+			break;
+		}
+
+		case opArith:
+			add(sp, calculate(op->u.arith, binding), QUOTED);
+			break;
 
-		case nFor:
-		return forloop(tree->u[0].p, tree->u[1].p, binding, flags);
+		case opCall:
+			share(sp, const_cast<List *>(execute(op->body, binding, 0)));
+			break;
 
-		case nMatch:
-		return matchpattern(tree->u[0].p, tree->u[1].p, binding);
+		case opCount: {
+			/* $#var skips the call if %count is the primitive */
+			static Symbol *sym = intern("fn-%count");
+			List *values = contents(sp--);
+			List *fn = varlookup(sym, binding);
+			Closure *cp;
+			if (fn != NULL && fn->next == NULL
+			    && (cp = getclosure(fn->term)) != NULL
+			    && cp->tree->kind == nPrim
+			    && streq(cp->tree->u[0].s, "count"))
+				add(sp, mkintcell(length(values), NULL), QUOTED);
+			else
+				share(sp, const_cast<List *>(
+					eval(mkstrcell("%count", values),
+					     binding, 0)));
+			break;
+		}
 
-		case nExtract:
-		return extractpattern(tree->u[0].p, tree->u[1].p, binding);
+		case opBindings:
+			pending = op->i ? NULL : binding;
+			cell = (op->j > 0) ? mkframe(op->j, pending) : NULL;
+			break;
 
-		default:
-		panic("walk: bad node kind %d", tree->kind);
+		case opBind: {
+			List *values = globbed(sp--);
+			List *vars = contents(sp--);
+			pending = letbindings(vars, values, pending, cell);
+			if (cell != NULL)
+				cell = pending + 1;
+			break;
+		}
+
+		case opForbind: {
+			List *values = globbed(sp--);
+			List *vars = contents(sp--);
+			pending = forbindings(vars, values, pending);
+			break;
+		}
+
+		case opEnter:
+			binding = pending;
+			break;
+
+		case opLocal:
+			return local(pending, op->body, binding, flags);
+
+		case opFor:
+			return forloop(pending, op->body, binding, flags);
+
+		case opTrue:
+			return ltrue;
 
+		case opEval:
+			return tail
+				? tailcall(globbed(sp), binding)
+				: eval(globbed(sp), binding, flags);
+
+		case opAssign: {
+			List *values = globbed(sp--);
+			List *vars = contents(sp);
+//			return mksafe(assign(vars, values, binding), !!(flags & eval_exitonfalse)); // TODO make this work
+			if (flags & eval_exitonfalse) {
+				assign(vars, values, binding);
+				return ltrue;
+			}
+			return assign(vars, values, binding);
+		}
+
+		case opSetlexical: {
+			List *values = globbed(sp--);
+			vardef(op->u.s, framelookup(binding, op->i, op->j), values);
+			return (flags & eval_exitonfalse) ? ltrue : values;
+		}
+
+		case opMatch: {
+			Frame *pattern = sp--;
+			if (pattern->shared != NULL)
+				materialize(pattern);
+			return listmatch(globbed(sp), pattern->list, pattern->quote)
+				? ltrue
+				: lfalse;
+		}
+
+		case opExtract: {
+			Frame *pattern = sp--;
+			if (pattern->shared != NULL)
+				materialize(pattern);
+			return extractmatches(globbed(sp), pattern->list,
+					      pattern->quote);
+		}
+
+		case opResult:
+			return globbed(sp);
+
+		default:
+			panic("execute: bad opcode %d", op->kind);
+		}
 	}
 	NOTREACHED;
 }
@@ -282,23 +529,33 @@ top:
 
 /* bindargs -- bind an argument list to the parameters of a lambda */
 extern Binding *bindargs(Tree* params, List* args, Binding* binding) {
+	int n = 0;
+	for (Tree *tp = params; tp != NULL; tp = tp->u[1].p)
+		++n;
+	if (n == 0)
+		return binding;
+
 	List* value;
 	Tree* param;
-	for (; params; params = params->u[1].p) {
+	Binding *frame = mkframe(n, binding);
+	for (; params; params = params->u[1].p, frame++) {
 		assert(params->kind == nList);
 		param = params->u[0].p;
 		assert(param->kind == nWord || param->kind == nQword);
 		assign_helper(value, args, params->u[1].p);
-		binding = mkbinding(param->u[0].s, value, binding);
+		validatevar(param->u[0].s);
+		frame->name = param->u[0].s;
+		frame->defn = value;
 	}
 
-	return binding;
+	return frame - 1;
 }
 
 /* pathsearch -- evaluate fn %pathsearch + some argument */
 extern const List *pathsearch(Term *term) {
+	static Symbol *sym = intern("fn-%pathsearch");
 	List *search, *list;
-	search = varlookup("fn-%pathsearch", NULL);
+	search = varlookup(sym, NULL);
 	if (search == NULL)
 		fail("xs:pathsearch", "%E: fn %%pathsearch undefined", term);
 	list = mklist(term, NULL);
@@ -318,9 +575,34 @@ class Depth_tracker {
 
 extern int is_dump;
 
+/* Funcname -- the dynamic binding of $0 while a function runs; a tail
+   call to another function rebinds it in place rather than nesting */
+class Funcname {
+public:
+	Funcname() : dyvar(NULL) {}
+	~Funcname() {
+		if (dyvar != NULL)
+			dyvar->~Dyvar();
+	}
+	void set(const char *name) {
+		List *defn = mktermcell(name, NULL, NULL);
+		if (dyvar == NULL)
+			dyvar = new (space) Dyvar("0", defn);
+		else
+			dyvar->rebind(defn);
+	}
+private:
+	Dyvar *dyvar;
+	union {
+		char space[sizeof (Dyvar)];
+		void *align;
+	};
+};
+
 /* eval -- evaluate a list, producing a list */
 extern const List *eval(const List* list, Binding* binding, int flags) {
 	Depth_tracker t;
+	Funcname zero;
 
 	Closure *volatile cp;
 
@@ -338,30 +620,20 @@ restart:
 			list = prim(cp->tree->u[0].s, list->next, binding, flags);
 			break;
 			case nThunk:
-			list = walk(cp->tree->u[0].p, cp->binding, flags);
+			list = execute(closurecode(cp), cp->binding, flags, true);
 			break;
 			case nLambda:
 			{
-				Tree* tree = cp->tree;
-				  
-				Binding* context =  bindargs(tree->u[0].p,
+				Binding* context =  bindargs(cp->tree->u[0].p,
 							 list->next,
 							 cp->binding);
-
-#define WALKFN walk(tree->u[1].p, context, flags)
-				if (funcname) {
-					Dyvar p("0",
-						 mklist(mkterm(funcname,
-							  NULL),
-					 	    NULL));
-
-					list = WALKFN;
-				} else list = WALKFN;
-#undef WALKFN
+				if (funcname)
+					zero.set(funcname);
+				list = execute(closurecode(cp), context, flags, true);
 			}
 			break;
 			case nList: {
-			List *t = glom(cp->tree, cp->binding, true);
+			const List *t = execute(closurecode(cp), cp->binding, flags);
 			list = append(t, t->next);
 			goto restart;
 			}
@@ -369,6 +641,12 @@ restart:
 			panic("eval: bad closure node kind %d",
 				  cp->tree->kind);
 			}
+		if (list == &tailmarker) {
+			list = tailcall_list;
+			binding = tailcall_binding;
+			funcname = NULL;
+			goto restart;
+		}
 		goto done;
 	}
 
@@ -1,5 +1,7 @@
 /* fd.cxx -- file descriptor manipulations */
 
+#define	REQUIRE_STAT	1
+
 #include "xs.hxx"
 #include <vector>
 using std::vector;
@@ -7,6 +9,10 @@ using std::vector;
 /* mvfd -- duplicate a fd and close the old */
 extern void mvfd(int old, int newFd) {
 	if (old != newFd) {
+		giveback(old);
+		giveback(newFd);
+		forgetready(old);
+		forgetready(newFd);
 		int fd = dup2(old, newFd);
 		if (fd == -1)
 			fail("xs:mvfd", "dup2: %s", xsstrerror(errno));
@@ -39,10 +45,11 @@ struct Defer {
 
 static vector<Defer> deftab;
 
-static void dodeferred(int realfd, int userfd) {
+static void dodeferred(int *realfdp, int userfd) {
 	assert(userfd >= 0);
-	releasefd(userfd);
+	releasefd(userfd);	/* may move *realfdp itself */
 
+	int realfd = *realfdp;
 	if (realfd == -1)
 		close(userfd);
 	else {
@@ -57,7 +64,7 @@ static int pushdefer(bool parent, int realfd, int userfd) {
 		deftab.push_back(d);
 		return deftab.size() - 1;
 	} else {
-		dodeferred(realfd, userfd);
+		dodeferred(&realfd, userfd);
 		return UNREGISTERED;
 	}
 }
@@ -78,8 +85,11 @@ extern void undefer(int ticket) {
 		assert(ticket >= 0);
 		assert (not deftab.empty());
 		assert(ticket == deftab.size() - 1);
-		if (deftab.rbegin()->realfd != -1)
+		if (deftab.rbegin()->realfd != -1) {
+			giveback(deftab.rbegin()->realfd);
+			forgetready(deftab.rbegin()->realfd);
 			close(deftab.rbegin()->realfd);
+		}
 		deftab.pop_back();
 	}
 }
@@ -101,8 +111,10 @@ extern int fdmap(int fd) {
 
 /* remapfds -- apply the fd map to the current file descriptor table */
 static void remapfds(void) {
-	foreach (Defer& defer, deftab)
-		dodeferred(defer.realfd, defer.userfd);
+	foreach (Defer& defer, deftab) {
+		dodeferred(&defer.realfd, defer.userfd);
+		defer.realfd = -1;	/* closed, so releasefd() mustn't move it */
+	}
 	deftab.clear();
 }
 
@@ -169,6 +181,46 @@ extern void closefds(void) {
 	}
 }
 
+#if USE_SPAWN
+/* spawnfds -- describe what closefds() would do, as posix_spawn actions;
+   false if closefds() would have to move a descriptor out of the way */
+extern bool spawnfds(posix_spawn_file_actions_t *actions) {
+	/* remapfds() moves a descriptor that a later entry still needs out
+	   of the way of an earlier one; rather than track where it goes,
+	   leave such tables to a forked child */
+	for (size_t i = 0; i < deftab.size(); i++)
+		for (size_t j = i + 1; j < deftab.size(); j++)
+			if (deftab[j].realfd == deftab[i].userfd)
+				return false;
+
+	foreach (Defer& defer, deftab)
+		if (defer.realfd == -1)
+			posix_spawn_file_actions_addclose(actions, defer.userfd);
+		else if (defer.realfd != defer.userfd) {
+			posix_spawn_file_actions_adddup2(actions, defer.realfd,
+							 defer.userfd);
+			posix_spawn_file_actions_addclose(actions, defer.realfd);
+		}
+
+	/* closefds() moves xs's own descriptors out of the way of the
+	   deferred ones before closing them; here, skip those instead */
+	for (int i = 0; i < rescount; i++) {
+		Reserve *r = &reserved[i];
+		int fd = *r->fdp;
+		if (!r->closeonfork || fd < 3)
+			continue;
+		bool skip = false;
+		foreach (Defer& defer, deftab)
+			if (r->fdp == &defer.realfd || fd == defer.userfd
+			    || fd == defer.realfd)
+				skip = true;
+		if (!skip)
+			posix_spawn_file_actions_addclose(actions, fd);
+	}
+	return true;
+}
+#endif
+
 /* releasefd -- release a specific file descriptor from its xs uses */
 extern void releasefd(int n) {
 	int i;
@@ -177,6 +229,8 @@ extern void releasefd(int n) {
 		int *fdp = reserved[i].fdp;
 		int fd = *fdp;
 		if (fd == n) {
+			giveback(fd);
+			forgetready(fd);
 			*fdp = dup(fd);
 			if (*fdp == -1) {
 				assert(errno != EBADF);
@@ -216,3 +270,148 @@ extern int newfd(void) {
 			}
 		}
 }
+
+
+/*
+ * read-ahead
+ *	$&read and $&getc take their bytes from a buffer filled a block at
+ *	a time, but only from a descriptor that can seek, so that what was
+ *	read ahead can be given back: the offset is moved back to the first
+ *	byte not used before any process is started or the shell exits, and
+ *	before the descriptor is moved or closed.  the offset is checked on
+ *	each use as well, in case something else has moved it.  a pipe or a
+ *	terminal can't take anything back, so it is still read a byte at a
+ *	time, and whatever runs after a read gets exactly what is left; that
+ *	it can't seek is remembered until it is moved or closed, so it isn't
+ *	asked again for every byte.
+ */
+
+enum { READAHEAD = 64 * 1024 };
+
+struct Readahead {
+	char *buf;		/* NULL if nothing is kept for this fd */
+	size_t pos, end;	/* the bytes not yet used */
+	off_t offset;		/* the file offset, just past buf[end - 1] */
+	dev_t dev;		/* which file it was */
+	ino_t ino;
+	bool unseekable;	/* lseek failed; not tried again until fd moves */
+};
+
+static vector<Readahead> readaheads;
+
+/* giveback -- return what was read ahead of fd to the file */
+extern void giveback(int fd) {
+	if (fd < 0 || (size_t) fd >= readaheads.size())
+		return;
+	Readahead *ra = &readaheads[fd];
+	ra->unseekable = false;
+	if (ra->buf == NULL)
+		return;
+	struct stat st;
+	if (ra->pos < ra->end
+	    && lseek(fd, 0, SEEK_CUR) == ra->offset
+	    && fstat(fd, &st) == 0 && st.st_dev == ra->dev && st.st_ino == ra->ino)
+		lseek(fd, ra->offset - (ra->end - ra->pos), SEEK_SET);
+	efree(ra->buf);
+	ra->buf = NULL;
+}
+
+/* givebackall -- return everything read ahead, before another process runs */
+extern void givebackall(void) {
+	for (size_t fd = 0; fd < readaheads.size(); fd++)
+		giveback(fd);
+}
+
+/* readahead -- the buffer for fd, or NULL if it can't be used */
+static Readahead *readahead(int fd) {
+	if ((size_t) fd >= readaheads.size()) {
+		if (readaheads.empty())
+			atexit(givebackall);
+		readaheads.resize(fd + 1);
+	}
+	Readahead *ra = &readaheads[fd];
+	if (ra->unseekable)
+		return NULL;
+	off_t offset = lseek(fd, 0, SEEK_CUR);
+	if (offset == -1) {
+		giveback(fd);
+		ra->unseekable = true;
+		return NULL;
+	}
+	if (ra->buf != NULL && ra->offset == offset)
+		return ra;
+	struct stat st;
+	if (fstat(fd, &st) == -1)
+		return NULL;
+	if (ra->buf == NULL)
+		ra->buf = reinterpret_cast<char *>(ealloc(READAHEAD));
+	ra->pos = ra->end = 0;
+	ra->offset = offset;
+	ra->dev = st.st_dev;
+	ra->ino = st.st_ino;
+	return ra;
+}
+
+/* readsome -- read into buf, retrying after signals that were handled */
+static long readsome(int fd, char *buf, size_t n) {
+	long nread;
+	do {
+		nread = eread(fd, buf, n);
+		SIGCHK();
+	} while (nread == -1 && errno == EINTR);
+	if (nread == -1)
+		fail("$&read/$&getc", xsstrerror(errno));
+	return nread;
+}
+
+/* fill -- refill an empty read-ahead buffer; false at end of file */
+static bool fill(int fd, Readahead *ra) {
+	long n = readsome(fd, ra->buf, READAHEAD);
+	ra->pos = 0;
+	ra->end = n;
+	ra->offset += n;
+	return n > 0;
+}
+
+/* readbyte -- the next byte from fd, or EOF */
+extern int readbyte(int fd) {
+	Readahead *ra = readahead(fd);
+	if (ra == NULL) {
+		unsigned char c;
+		return readsome(fd, (char *) &c, 1) == 0 ? EOF : c;
+	}
+	if (ra->pos == ra->end && !fill(fd, ra))
+		return EOF;
+	return (unsigned char) ra->buf[ra->pos++];
+}
+
+/*
+ * readuntil -- append the bytes from fd up to delim to line, and return
+ *	delim, or EOF if the file ended first
+ */
+extern int readuntil(int fd, int delim, std::string &line) {
+	Readahead *ra = readahead(fd);
+	if (ra == NULL) {
+		unsigned char c;
+		while (readsome(fd, (char *) &c, 1) != 0) {
+			if (c == delim)
+				return delim;
+			line += (char) c;
+		}
+		return EOF;
+	}
+	for (;;) {
+		if (ra->pos == ra->end && !fill(fd, ra))
+			return EOF;
+		const char *start = ra->buf + ra->pos;
+		size_t n = ra->end - ra->pos;
+		const char *p = reinterpret_cast<const char *>(memchr(start, delim, n));
+		if (p != NULL) {
+			line.append(start, p - start);
+			ra->pos += p - start + 1;
+			return delim;
+		}
+		line.append(start, n);
+		ra->pos = ra->end;
+	}
+}
@@ -5,33 +5,104 @@
 
 #include "xs.hxx"
 #include "term.hxx"
+#include <climits>
+
+static const struct { int n; int end[2]; } quoted = { 2, { 0, INT_MAX } };
+static const Quote unquoted = { 1, { INT_MAX } };
+const Quote *QUOTED = reinterpret_cast<const Quote *>(&quoted);
+const Quote *UNQUOTED = &unquoted;
+
+/* mkquotelist -- add a quote to the front of a list of them */
+extern QuoteList *mkquotelist(const Quote *quote, QuoteList *next) {
+	QuoteList *list = gcnew(QuoteList);
+	list->quote = quote;
+	list->next = next;
+	return list;
+}
 
-const char *QUOTED = "QUOTED", *UNQUOTED = "r";
+/* newquote -- room for a quote of up to n runs */
+static Quote *newquote(int n) {
+	Quote *q = reinterpret_cast<Quote *>(
+		galloc_atomic(offsetof(Quote, end) + n * sizeof (int)));
+	q->n = 0;
+	return q;
+}
+
+/* qpush -- add a run ending at end to a quote being built */
+static void qpush(Quote *q, int quoted, int end) {
+	if (q->n > 0 && ((q->n - 1) & 1) == quoted) {
+		q->end[q->n - 1] = end;
+		return;
+	}
+	if (q->n == 0 && quoted)
+		q->end[q->n++] = 0;
+	q->end[q->n++] = end;
+}
+
+/* qruns -- add the runs of q over [start, start + len) to r, at off */
+static void qruns(Quote *r, const Quote *q, int start, int len, int off) {
+	int limit = start + len;
+	for (int k = 0, begin = 0; k < q->n && begin < limit; k++) {
+		int b = begin > start ? begin : start;
+		int e = q->end[k] < limit ? q->end[k] : limit;
+		if (e > b)
+			qpush(r, k & 1, off + e - start);
+		begin = q->end[k];
+	}
+}
+
+/* qdone -- a finished quote, unless it's QUOTED or UNQUOTED after all */
+static const Quote *qdone(const Quote *q) {
+	if (q->n <= 1)
+		return UNQUOTED;
+	if (q->n == 2 && q->end[0] == 0)
+		return QUOTED;
+	return q;
+}
+
+/* qcat -- the quoting of two words joined together */
+extern const Quote *qcat(const Quote *q1, size_t len1,
+			 const Quote *q2, size_t len2) {
+	if (len2 == 0 || (q1 == q2 && (q1 == QUOTED || q1 == UNQUOTED)))
+		return q1;
+	if (len1 == 0)
+		return q2;
+	Quote *q = newquote(q1->n + q2->n + 1);
+	qruns(q, q1, 0, len1, 0);
+	qruns(q, q2, 0, len2, len1);
+	return qdone(q);
+}
+
+/* qslice -- the quoting of part of a word */
+extern const Quote *qslice(const Quote *q, size_t start, size_t len) {
+	if (q == QUOTED || q == UNQUOTED)
+		return q;
+	Quote *r = newquote(q->n + 1);
+	qruns(r, q, start, len, 0);
+	return qdone(r);
+}
 
 /* hastilde -- true iff the first character is a ~ and it is not quoted */
-static bool hastilde(const char *s, const char *q) {
-	return *s == '~' && IS_RAW(q);
+static bool hastilde(const char *s, const Quote *q) {
+	return *s == '~' && !isquoted(q, 0);
 }
 
 /* haswild -- true iff some unquoted character is a wildcard character */
-extern bool haswild(const char *s, const char *q) {
+extern bool haswild(const char *s, const Quote *q) {
 	if (q == QUOTED)
 		return false;
-	if (q == UNQUOTED)
-		for (;;) {
-			int c = *s++;
+	for (int k = 0, i = 0; k < q->n; k += 2) {
+		for (; i < q->end[k]; i++) {
+			int c = s[i];
 			if (c == '\0')
 				return false;
 			if (c == '*' || c == '?' || c == '[')
 				return true;
 		}
-	for (;;) {
-		int c = *s++, r = *q++;
-		if (c == '\0')
-			return false;
-		if ((c == '*' || c == '?' || c == '[') && (r == 'r'))
-			return true;
+		if (k + 1 < q->n)
+			i = q->end[k + 1];
 	}
+	return false;
 }
 
 /* ishiddenfile -- return ltrue if the file is a dot file to be hidden */
@@ -43,7 +114,7 @@ static int ishiddenfile(const char *s) {
 List* dirmatch(const char* prefix, 
 	       const char* dirname,
 	       const char* pattern, 
-	       const char* quote) 
+	       const Quote* quote) 
 {
 	static struct stat s;
 
@@ -59,12 +130,13 @@ List* dirmatch(const char* prefix,
 		char *name = str("%s%s", prefix, pattern);
 		if (lstat(name, &s) == -1)
 			return NULL;
-		return mklist(mkstr(name), NULL);
+		return mkstrcell(name, NULL);
 	}
 
 	DIR *dirp = opendir(dirname);
 	if (dirp == NULL)
 		return NULL;
+	Pattern *pat = compilepattern(pattern, quote);
 
 	List* list = NULL; 
 	 /* The structure containing t->next could be forwarded,
@@ -72,10 +144,10 @@ List* dirmatch(const char* prefix,
 	List **prevp = &list;
 	Dirent *dp;
 	while ((dp = readdir(dirp)) != NULL)
-		if (match(dp->d_name, pattern, quote)
+		if (patternmatch(pat, dp->d_name)
 		    && (!ishiddenfile(dp->d_name) || *pattern == '.')) {
-			List *t = mklist(mkstr(str("%s%s",
-						    prefix, dp->d_name)),
+			List *t = mkstrcell(str("%s%s",
+						    prefix, dp->d_name),
 					  NULL);
 			*prevp = t;
 			prevp = &t->next;
@@ -87,7 +159,7 @@ List* dirmatch(const char* prefix,
 }
 
 /* listglob -- glob a directory plus a filename pattern into a list of names */
-static List* listglob(List* list, const char *pattern, const char *quote,
+static List* listglob(List* list, const char *pattern, const Quote *quote,
                       size_t slashcount) {
 	List* result = NULL;
 	List **prevp;
@@ -121,21 +193,19 @@ static List* listglob(List* list, const char *pattern, const char *quote,
 }
 
 /* glob1 -- glob pattern path against the file system */
-static List* glob1(const char* pattern, const char* quote) {
+static List* glob1(const char* pattern, const Quote* quote) {
 	assert(quote != QUOTED);
 
-	std::string dir, qdir;
-	const char *q = quote;
+	std::string dir;
 	const char *s = pattern;
 	if (*s == '/')
 		while (*s == '/')
-			dir.push_back(*s++),
-                        qdir.push_back(quote == UNQUOTED ? 'r' : *q++);
+			dir.push_back(*s++);
 	else
 		while (*s != '/' && *s != '\0')
-			dir.push_back(*s++),
-                        qdir.push_back(quote == UNQUOTED ? 'r' : *q++);
+			dir.push_back(*s++);
                         /* get first directory component */
+	const Quote *qdir = qslice(quote, 0, dir.size());
 
 	/*
 	 * Special case: no slashes in the pattern, i.e., open the current
@@ -143,22 +213,23 @@ static List* glob1(const char* pattern, const char* quote) {
          * other way *s could be zero) since doglob gets called iff there's
          * a metacharacter to be matched
 	 */
-	if (*s == '\0') return dirmatch("", ".", dir.c_str(), qdir.c_str());
+	if (*s == '\0') return dirmatch("", ".", dir.c_str(), qdir);
 
 	List* matched = *pattern == '/'
-			? mklist(mkstr(dir.c_str()), NULL)
-			: dirmatch("", ".", dir.c_str(), qdir.c_str());
+			? mkstrcell(dir.c_str(), NULL)
+			: dirmatch("", ".", dir.c_str(), qdir);
 	do {
 		SIGCHK();
 		size_t slashcount = 0;
-		for (; *s == '/'; s++, q++)
+		for (; *s == '/'; s++)
 			slashcount++; /* skip slashes */
-		std::string pat, qpat;
+		std::string pat;
+		const char *begin = s;
 		while (*s != '/' && *s != '\0')
-			pat.push_back(*s++),
+			pat.push_back(*s++);
 			/* get pat */
-                        qpat.push_back(quote == UNQUOTED ? 'r' : *q++);
-		matched = listglob(matched, pat.c_str(), qpat.c_str(),
+		matched = listglob(matched, pat.c_str(),
+				   qslice(quote, begin - pattern, pat.size()),
 				   slashcount);
 	} while (*s != '\0' && matched != NULL);
 
@@ -168,7 +239,7 @@ static List* glob1(const char* pattern, const char* quote) {
 
 /* glob0 -- glob a list, (destructively) passing through entries we
    don't care about */
-static List* glob0(List* list, StrList* quote) {
+static List* glob0(List* list, QuoteList* quote) {
 	List* result; 
 	List* expand1;
 	List **prevp;
@@ -178,10 +249,10 @@ static List* glob0(List* list, StrList* quote) {
 	     list = list->next, quote = quote->next) {
 		const char* str;
 		if (
-			quote->str == QUOTED
-			|| !haswild((str = getstr(list->term)), quote->str)
+			quote->quote == QUOTED
+			|| !haswild((str = getstr(list->term)), quote->quote)
 			// No matches
-                        || (expand1 = glob1(str, quote->str)) == NULL
+                        || (expand1 = glob1(str, quote->quote)) == NULL
 		) {
 			*prevp = list;
 			prevp = &list->next;
@@ -198,12 +269,12 @@ static List* glob0(List* list, StrList* quote) {
 }
 
 /* expandhome -- do tilde expansion by calling fn %home */
-static char *expandhome(char* string, StrList* quote) {
+static char *expandhome(char* string, QuoteList* quote) {
 	size_t slash;
 	List* fn = varlookup("fn-%home", NULL);
 
 	assert(*string == '~');
-	assert(IS_RAW(quote->str));
+	assert(!isquoted(quote->quote, 0));
 
 	if (fn == NULL) return string;
 	
@@ -213,7 +284,7 @@ static char *expandhome(char* string, StrList* quote) {
 
 	const List* list = NULL;
 	if (slash > 1)
-		list = mklist(mkstr(gcndup(string + 1, slash - 1)), NULL);
+		list = mkstrcell(gcndup(string + 1, slash - 1), NULL);
 
 	list = eval(append(fn, const_cast<List*>(list)), NULL, 0);
 
@@ -224,38 +295,24 @@ static char *expandhome(char* string, StrList* quote) {
 		char* home = gcdup(getstr(list->term));
 		if (c == '\0') {
 			string = home;
-			quote->str = QUOTED;
+			quote->quote = QUOTED;
 		} else {
 			size_t pathlen = strlen(string);
 			size_t homelen = strlen(home);
 			size_t len = pathlen - slash + homelen;
 			{
 				char* t =
-					reinterpret_cast<char*>(galloc(len+1));
+					reinterpret_cast<char*>(galloc_atomic(len+1));
 				memcpy(t, home, homelen);
 				memcpy(&t[homelen], &string[slash],
 				       pathlen-slash);
 				t[len] = '\0';
 				string = t;
 			}
-			if (quote->str == UNQUOTED) {
-				char *q =
-					reinterpret_cast<char*>(galloc(len+1));
-				memset(q, 'q', homelen);
-				memset(&q[homelen], 'r', pathlen - slash);
-				q[len] = '\0';
-				quote->str = q;
-			} else if (strchr(quote->str, 'r') == NULL)
-				quote->str = QUOTED;
-			else {
-				char *q =
-					reinterpret_cast<char*>(galloc(len+1));
-				memset(q, 'q', homelen);
-				memcpy(&q[homelen], &quote->str[slash],
-				       pathlen-slash);
-				q[len] = '\0';
-				quote->str = q;
-			}
+			quote->quote = qcat(QUOTED, homelen,
+					    qslice(quote->quote, slash,
+						   pathlen - slash),
+					    pathlen - slash);
 		}
 	}
 	return string;
@@ -263,27 +320,23 @@ static char *expandhome(char* string, StrList* quote) {
 
 /* glob -- globbing prepass (glob if we need to, and dispatch for
    tilde expansion) */
-extern List* glob(List* list, StrList* quote) {
+extern List* glob(List* list, QuoteList* quote) {
 	List* lp;
-	StrList* qp;
+	QuoteList* qp;
 	bool doglobbing = false;
 
 	for (lp = list, qp = quote; lp; lp = lp->next, qp = qp->next)
-		if (qp->str != QUOTED) {
+		if (qp->quote != QUOTED) {
 			assert(lp->term != NULL);
 			assert(!isclosure(lp->term));
-			char* str = gcdup(getstr(lp->term));
-			assert(qp->str == UNQUOTED || \
-			       strlen(qp->str) == strlen(str));
-			if (hastilde(str, qp->str)) {
-				str = expandhome(str, qp);
-				/* Safety against forwarding of lp */
-				Term *t = mkstr(str);
-				lp->term = t;
+			const char* str = getstr(lp->term);
+			/* terms may be shared, so replace rather than change */
+			if (hastilde(str, qp->quote)) {
+				str = expandhome(gcdup(str), qp);
+				lp->term = mkstr(str);
 			}
-			if (haswild(str, qp->str))
+			if (haswild(str, qp->quote))
 				doglobbing = true;
-			lp->term->str = str;
 		}
 
 	if (!doglobbing) return list;
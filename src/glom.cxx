@@ -1,16 +1,14 @@
-/* glom.cxx -- walk parse tree to produce list */
+/* glom.cxx -- list-building operations used by execute() */
 
 #include "xs.hxx"
-#include <sstream>
-#include <functional>
+#include "term.hxx"
+#include "code.hxx"
 #include <cmath>
-#include <climits>
+#include <algorithm>
 #include <cstdint>
 
-static List *calculate(Tree *, Binding *);
-
 /* concat -- cartesion cross product concatenation */
-static List *concat(List* list1,List* list2) {
+extern List *concat(List* list1,List* list2) {
 	List* result = NULL;
 	List **p = &result;
 	iterate (list1) {
@@ -23,63 +21,35 @@ static List *concat(List* list1,List* list2) {
 	return result;
 }
 
-/* qcat -- concatenate two quote flag terms */
-static const char *qcat(const char* q1,
-			const char* q2,
-			Term* t1,
-			Term* t2)
-{
-	if (q1 == QUOTED && q2 == QUOTED)
-		return QUOTED;
-	if (q1 == UNQUOTED && q2 == UNQUOTED)
-		return UNQUOTED;
-
-	size_t len1 = (q1 == QUOTED || q1 == UNQUOTED)
-		? strlen(getstr(t1))
-		: strlen(q1);
-	size_t len2 = (q2 == QUOTED || q2 == UNQUOTED)
-		? strlen(getstr(t2))
-		: strlen(q2);
-	char* s = reinterpret_cast<char*>(galloc(len1 + len2 + 1));
-
-	if (q1 == QUOTED)
-		memset(s, 'q', len1);
-	else if (q1 == UNQUOTED)
-		memset(s, 'r', len1);
-	else
-		memcpy(s, q1, len1);
-		
-	if (q2 == QUOTED)
-		memset(&s[len1], 'q', len2);
-	else if (q2 == UNQUOTED)
-		memset(&s[len1], 'r', len2);
-	else
-		memcpy(&s[len1], q2, len2);
-	s[len1 + len2] = '\0';
-
-	return s;
+/* qjoin -- the quoting of two terms joined together */
+static const Quote *qjoin(const Quote *q1, const Quote *q2,
+			  Term *t1, Term *t2) {
+	if (q1 == q2 && (q1 == QUOTED || q1 == UNQUOTED))
+		return q1;
+	return qcat(q1, strlen(getstr(t1)), q2, strlen(getstr(t2)));
 }
 
 #define DUAL_ITERATE(list, quote) \
         for(; list != NULL; list = list->next, quote = quote->next)
 
 /* qconcat -- cartesion cross product concatenation; also produces a quote list */
-static List *qconcat(List* list1, List* list2,
-		     StrList* ql1, StrList* ql2, 
-		     StrList **quotep) 
+extern List *qconcat(List* list1, List* list2,
+		     QuoteList* ql1, QuoteList* ql2, 
+		     QuoteList **quotep) 
 {
 	List* result = NULL; 
 	List **p = &result;
-	StrList **qp = quotep;
+	QuoteList **qp = quotep;
 
 	DUAL_ITERATE(list1, ql1) {
 		List* lp = list2;
-		StrList* qlp = ql2;
+		QuoteList* qlp = ql2;
 		DUAL_ITERATE(lp, qlp) {
 			*p = mklist(termcat(list1->term, lp->term), NULL);
 			p = &(*p)->next;
-			*qp = mkstrlist(
-				qcat(ql1->str, qlp->str, list1->term, lp->term),
+			*qp = mkquotelist(
+				qjoin(ql1->quote, qlp->quote,
+				      list1->term, lp->term),
 				NULL);
 			qp = &(*qp)->next;
 		}
@@ -88,20 +58,16 @@ static List *qconcat(List* list1, List* list2,
 }
 
 /* subscript -- variable subscripting */
-static List *subscript(List* list, List* subs) {
-	int lo, hi, len = length(list), counter = 1;
-	List *result = NULL, *current = list;
-	List **prevp = &result;
-	int r = 0;
+extern List *subscript(List* list, List* subs) {
+	int lo, hi, len = length(list);
+	std::vector< Term *, gc_allocator<Term *> > terms;
 
 	if (subs != NULL && streq(getstr(subs->term), "...")) {
 		lo = 1;
 		goto mid_range;
 	}
 
-	 /* prevp could point to pointer in structure which is forwarded */
 	while (subs != NULL) {
-		r = 0;
 		lo = atoi(getstr(subs->term));
 		if (lo < 1) {
 			fail("xs:subscript", "bad subscript: %s",
@@ -126,332 +92,191 @@ static List *subscript(List* list, List* subs) {
 			}
 		} else hi = lo;
 		if (lo > len) continue;
-		if (counter > lo) {
-			current = list;
-			counter = 1;
-		}
-		if (lo > hi) { r = 1; int t = lo; lo = hi; hi = t; }
-		List **spp = prevp;
-		while (counter < lo) ++counter, current = current->next;
-		for (; counter <= hi; ++counter, current = current->next) {
-			*prevp = mklist(current->term, NULL);
-			prevp = &(*prevp)->next;
-		}
-		if (r) {
-			*spp = reverse(*spp);
-			List *f = *spp;
-			while (f) {
-				prevp = &(f->next);
-				f = f->next;
-			}
-		}
-	}
-	
-
-	return result;
-}
-
-/* glom1 -- glom when we don't need to produce a quote list */
-static List *glom1(Tree* tree, Binding* binding) {
-	List* result = NULL;
-	List* tail = NULL;
-
-	while (tree != NULL) {
-		List* list = NULL;
-
-		switch (tree->kind) {
-		case nQword:
-			list = mklist(mkterm(tree->u[0].s, NULL), NULL);
-			tree = NULL;
-			break;
-		case nWord:
-			list = mklist(mkterm(tree->u[0].s, NULL), NULL);
-			tree = NULL;
-			break;
-		case nThunk:
-		case nLambda:
-			list = mklist(mkterm(NULL, mkclosure(tree, binding)),
-                                      NULL);
-			tree = NULL;
-			break;
-		case nPrim:
-			list = mklist(mkterm(NULL, mkclosure(tree, NULL)),
-                                      NULL);
-			tree = NULL;
-			break;
-		case nVar: {
-			List* var = glom1(tree->u[0].p, binding);
-			tree = NULL;
-			for (; var != NULL; var = var->next) {
-				list = listcopy(varlookup(getstr(var->term),
-                                                binding));
-				if (list != NULL) {
-					if (result == NULL)
-						tail = result = list;
-					else
-						tail->next = list;
-					for (; tail->next != NULL;
-                                             tail = tail->next)
-						;
-				}
-				list = NULL;
-			}
-			break;
-		}
-		case nVarsub:
-			list = glom1(tree->u[0].p, binding);
-			if (list == NULL) fail("xs:glom1",
-                                               "null variable name in subscript");
-			if (list->next != NULL)
-                                fail("xs:glom1",
-                                     "multi-word variable name in subscript");
-
-			{
-				const char* name = getstr(list->term);
-				list = varlookup(name, binding);
-				List* sub = glom1(tree->u[1].p, binding);
-				tree = NULL;
-				list = subscript(list, sub);
-			}
-			break;
-		case nArith:
-			list = calculate(tree->u[0].p, binding);
-			tree = NULL;
-			break;
-		case nCall:
-			list = listcopy(walk(tree->u[0].p, binding, 0));
-			tree = NULL;
-			break;
-		case nList:
-			list = glom1(tree->u[0].p, binding);
-			tree = tree->u[1].p;
-			break;
-		case nConcat: {
-			List* l = glom1(tree->u[0].p, binding);
-			List* r = glom1(tree->u[1].p, binding);
-			tree = NULL;
-			list = concat(l, r);
-			break;
-	        }
-		default:
-			fail("xs:glom1", "bad node kind %d", tree->kind);
-		}
-
-		if (list != NULL) {
-			if (result == NULL) 	tail = result = list;
-			else			tail->next = list;
-			while(tail->next != NULL) tail = tail->next;
-		}
+		/* a backwards range selects its elements in reverse */
+		bool r = lo > hi;
+		size_t first = terms.size();
+		List *lp = nthlist(list, r ? hi : lo);
+		for (int n = abs(hi - lo); n >= 0; --n, lp = lp->next)
+			terms.push_back(lp->term);
+		if (r)
+			std::reverse(terms.begin() + first, terms.end());
 	}
 
-	return result;
+	return mklists(terms.data(), terms.size(), NULL);
 }
 
-/* glom2 -- glom and produce a quoting list */
-extern List *glom2(Tree* tree, Binding* binding, StrList **quotep) {
-	List* result = NULL;
-	List* tail = NULL;
-	StrList* qtail = NULL;
-
-	assert(quotep != NULL);
-
-	/*
-	 * this loop covers only the cases where we might produce some
-	 * unquoted (raw) values.  all other cases are handled in glom1
-	 * and we just add quoted word flags to them.
-	 */
-
-	while (tree != NULL) {
-		List* list = NULL;
-		StrList* qlist = NULL;
-
-		switch (tree->kind) {
-		case nWord:
-			list = mklist(mkterm(tree->u[0].s, NULL), NULL);
-			qlist = mkstrlist(UNQUOTED, NULL);
-			tree = NULL;
-			break;
-		case nList:
-			list = glom2(tree->u[0].p, binding, &qlist);
-			tree = tree->u[1].p;
-			break;
-		case nConcat: {
-			StrList *ql = NULL, *qr = NULL;
-			List *l = glom2(tree->u[0].p, binding, &ql),
-			     *r = glom2(tree->u[1].p, binding, &qr);
-			list = qconcat(l, r, ql, qr, &qlist);
-			tree = NULL;
-			break;
-		}
-		default:
-			list = glom1(tree, binding);
-			for (List* lp = list; lp != NULL; lp = lp->next)
-				qlist = mkstrlist(QUOTED, qlist);
-			tree = NULL;
-			break;
-		}
-
-		if (list != NULL) {
-			if (result == NULL) {
-				assert(*quotep == NULL);
-				result = tail = list;
-				*quotep = qtail = qlist;
-			} else {
-				assert(*quotep != NULL);
-				tail->next = list;
-				qtail->next = qlist;
-			}
-			for (; tail->next != NULL;
-                             tail = tail->next, qtail = qtail->next)
-				;
-			assert(qtail->next == NULL);
-		}
-	}
+/*
+ * arithmetic
+ *	integers are 64 bits and wrap around on overflow; an operation on
+ *	two integers gives an integer, except that dividing by zero gives
+ *	infinity.  comparisons give 1 or 0.
+ */
 
-	return result;
+static Number intnum(int64_t i) {
+	Number n;
+	n.type = num_int;
+	n.u.i = i;
+	return n;
 }
 
-/* glom -- top level glom dispatching */
-extern List* glom(Tree* tree, Binding* binding, bool globit) {
-	if (globit) {
-		StrList* quote = NULL;
-		List* list = glom2(tree, binding, &quote);
-		return glob(list, quote);
-	} else return glom1(tree, binding);
+static Number floatnum(double d) {
+	Number n;
+	n.type = num_float;
+	n.u.d = d;
+	return n;
 }
 
-/* Arithmetic code 
- * Currently horifically inefficient on account of constantly 
-   converting to-and-from string representation.
- */
-
-static List *i64tolist(int64_t x) {
-	return mklist(mkstr(str("%lld", x)), NULL);
+static double floatval(Number n) {
+	return n.type == num_int ? n.u.i : n.u.d;
 }
 
-static List *tolist(int x) {
-	return mklist(mkstr(str("%d", x)), NULL);
+/* wrap -- arithmetic on integers, without undefined overflow */
+static int64_t wrap(uint64_t i) {
+	return i;
 }
-static List *tolist(double x) {
-	std::stringstream s;
-	s.setf(std::ios_base::showpoint);
-	s << x;
-	return mklist(mkstr(gcdup(s.str().c_str())), NULL);
-}
-static bool isint(List *x) {
-	return strchr(getstr(x->term), '.') == NULL;
-}
-
 
-static int toint(List *x) {
-	errno = 0;
-	char *end = NULL;
-	long val = strtol(getstr(x->term), &end, 10);
-
-	if (EINVAL == errno || ERANGE == errno || NULL == end || *end) {
-		fail("glom:arith:toint", "Could not handle integer input");
+static int64_t intpow(int64_t a, int64_t b) {
+	uint64_t result = 1, base = a;
+	for (; b > 0; b >>= 1) {
+		if (b & 1)
+			result *= base;
+		base *= base;
 	}
-
-	return val;
+	return wrap(result);
 }
-static double todouble(List *x) {
-	errno = 0;
-	char *end = NULL;
 
-	double val = strtod(getstr(x->term), &end);
-
-	if (EINVAL == errno || NULL == end || *end) {
-		fail("glom:arith:todouble", "Could not handle floating point input");
+static Number compare(Arithop kind, Number a, Number b) {
+	int r;
+	if (a.type == num_int && b.type == num_int)
+		r = a.u.i < b.u.i ? -1 : a.u.i > b.u.i;
+	else {
+		double x = floatval(a), y = floatval(b);
+		if (x != x || y != y)	/* NaN is unordered */
+			return intnum(kind == aNotEqual);
+		r = x < y ? -1 : x > y;
+	}
+	switch (kind) {
+	case aLess:		return intnum(r < 0);
+	case aLessEqual:	return intnum(r <= 0);
+	case aGreater:		return intnum(r > 0);
+	case aGreaterEqual:	return intnum(r >= 0);
+	case aEqual:		return intnum(r == 0);
+	default:		return intnum(r != 0);
 	}
-
-	return val;
-}
-
-#define OP(f, x, y) op(f<int>(), f<double>(), x, y)
-
-template <typename ftint, typename ftdouble>
-static List *op(ftint intf, 
-		ftdouble doublef, 
-		List *x, List *y) {
-	return isint(x) && isint(y)
-		? tolist(intf(toint(x), toint(y)))
-		: tolist(doublef(todouble(x), todouble(y)));
 }
 
-/* calculate -- Take an arithmetic tree, produce result */
-static List *calculate(Tree *expr, Binding *binding) {
-	int64_t ival;
-	double dval;
-	char *end = NULL;
-
-	errno = 0;
-
-	switch (expr->kind) {
-	case nInt:
-		ival = strtoll(expr->u[0].s, &end, 10);
-
-		// TODO: officially support 64-bit ints
-
-		if (EINVAL == errno || ERANGE == errno || NULL == end || *end || (1 && (INT_MAX < ival || INT_MIN > ival))) {
-			fail("glom:arith:calculate", "Could not handle integer input");
-		}
-
-		return i64tolist(ival);
-	case nFloat:
-		dval = strtod(expr->u[0].s, &end);
-
-		if (EINVAL == errno || NULL == end || *end) {
-			fail("glom:arith:calculate", "Could not handle floating point input");
-		}
-
-		return tolist(dval);
-	case nVar:
-		{
-		List *var = glom1(expr->u[0].p, binding);
-		List *value = varlookup(getstr(var->term), binding);
-		if (value == NULL) return tolist(0);
-		/* FIXME: Add some validity checks, not everything is a number */
-		return value;
-		}
-#define EXPR1 calculate(expr->u[0].p, binding)
-#define EXPR2 calculate(expr->u[1].p, binding)
-	case nPlus: // NOTE: std::plus<int>(EXPR1, EXPR2) || std::plus<double>(EXPR1, EXPR2)
-		return OP(std::plus, EXPR1, EXPR2);
-	case nMinus:
-		return OP(std::minus, EXPR1, EXPR2);
-	case nMult:
-		return OP(std::multiplies, EXPR1, EXPR2);
-	case nDivide:
-		{
-		List *a = EXPR1, *b = EXPR2;
-		// Integer division by 0 causes issues
-		if (isint(b) and toint(b) == 0)
-			return tolist(INFINITY);
-		return OP(std::divides, a, b);
-		}
-	case nModulus:
-		{
-		List *a = EXPR1, *b = EXPR2;
-		if (isint(b) and toint(b) == 0)
-			return tolist(INFINITY);
-		if (not isint(b) and todouble(b) == 0.0)
-			return tolist(INFINITY);
-		double r = std::fmod(todouble(a), todouble(b));
-		if (isint(a) and isint(b)) return tolist(static_cast<int>(r));
-		else return tolist(r);
+/* arithop -- apply an operator; b is ignored for unary ones */
+extern Number arithop(Arithop kind, Number a, Number b) {
+	if (kind >= aLess)
+		return compare(kind, a, b);
+	if (kind == aNegate)
+		return a.type == num_int
+			? intnum(wrap(-(uint64_t) a.u.i))
+			: floatnum(-a.u.d);
+
+	if (a.type == num_int && b.type == num_int) {
+		int64_t x = a.u.i, y = b.u.i;
+		switch (kind) {
+		case aPlus:	return intnum(wrap((uint64_t) x + y));
+		case aMinus:	return intnum(wrap((uint64_t) x - y));
+		case aMult:	return intnum(wrap((uint64_t) x * y));
+		case aDivide:
+			if (y == 0)
+				return floatnum(INFINITY);
+			if (y == -1)
+				return intnum(wrap(-(uint64_t) x));
+			return intnum(x / y);
+		case aModulus:
+			if (y == 0)
+				return floatnum(INFINITY);
+			if (y == -1)
+				return intnum(0);
+			return intnum(x % y);
+		case aPow:
+			if (y >= 0)
+				return intnum(intpow(x, y));
+			if (x == 0)
+				return floatnum(INFINITY);
+			/* only 1 and -1 have integral negative powers */
+			return intnum(x == 1 ? 1 : x == -1 ? (y & 1 ? -1 : 1) : 0);
+		default:
+			break;
 		}
-	case nPow:
-		{
-		List *a = EXPR1, *b = EXPR2;
-		double r = std::pow(todouble(a), todouble(b));
-		if (isint(a) and isint(b)) return tolist(static_cast<int>(r));
-		else return tolist(r);
+	} else {
+		double x = floatval(a), y = floatval(b);
+		switch (kind) {
+		case aPlus:	return floatnum(x + y);
+		case aMinus:	return floatnum(x - y);
+		case aMult:	return floatnum(x * y);
+		case aDivide:	return floatnum(x / y);
+		case aModulus:
+			if (y == 0.0)
+				return floatnum(INFINITY);
+			return floatnum(std::fmod(x, y));
+		case aPow:	return floatnum(std::pow(x, y));
+		default:
+			break;
 		}
-#undef EXPR1
-#undef EXPR2
-	default:
-		fail("xs:calculate", "bad expr kind %d", expr->kind);
 	}
+	panic("arithop: bad operator %d", kind);
 }
 
+/* number -- the value of a variable in an arithmetic expression */
+static Number number(List *value, bool count) {
+	if (count)
+		return intnum(length(value));
+	if (value == NULL)
+		return intnum(0);
+	Term *term = value->term;
+	switch (numval(term)) {
+	case num_int:	return intnum(term->num.i);
+	case num_float:	return floatnum(term->num.d);
+	default:	break;
+	}
+	if (strchr(getstr(term), '.') == NULL)
+		fail("glom:arith:toint", "Could not handle integer input");
+	fail("glom:arith:todouble", "Could not handle floating point input");
+}
 
+/* calculate -- run an arithmetic program, produce result */
+extern List *calculate(Arith *arith, Binding *binding) {
+	Number buf[16];
+	Number *stack = arith->depth <= 16
+		? buf
+		: reinterpret_cast<Number *>(galloc_atomic(arith->depth * sizeof (Number)));
+	Number *sp = stack;
+	Aop *op = arith->ops, *end = op + arith->nops;
+	for (; op < end; op++)
+		switch (op->kind) {
+		case aConst:
+			*sp++ = op->u.n;
+			break;
+		case aLexical:
+			*sp++ = number(framelookup(binding, op->i, op->j)->defn,
+				       op->count);
+			break;
+		case aLookup:
+			*sp++ = number(varlookup(op->u.sym,
+						 op->i < 0
+						 	? NULL
+							: frameskip(binding, op->i)),
+				       op->count);
+			break;
+		case aName:
+			*sp++ = number(varlookup(op->u.s, binding), op->count);
+			break;
+		case aBad:
+			fail("glom:arith:calculate", "%s", op->u.s);
+		case aNegate:
+			sp[-1] = arithop(aNegate, sp[-1], sp[-1]);
+			break;
+		default:
+			--sp;
+			sp[-1] = arithop(op->kind, sp[-1], sp[0]);
+			break;
+		}
+	assert(sp == stack + 1);
+	return stack->type == num_int
+		? mkintcell(stack->u.i, NULL)
+		: mklist(mkfloat(stack->u.d), NULL);
+}
@@ -62,6 +62,8 @@ fn-echo		= $&echo
 fn-exec		= $&exec
 fn-forever	= $&forever
 fn-fork		= $&fork
+fn-lines	= $&lines
+fn-matcher	= $&matcher
 fn-newpgrp	= $&newpgrp
 fn-pause	= $&pause
 fn-read		= $&read
@@ -226,13 +228,7 @@ fn-while = { |cond body|
 	until { ! $cond } $body
 }
 
-fn-byline = {|fn-body|
-	let (_byline_line = ()) {
-		until {_byline_line = <=read; ~ $_byline_line ()} {
-			body $_byline_line
-		}
-	}
-}
+fn-byline = {|body| $&lines 0 $body}
 
 fn-switch = { |value args| escape { |fn-return|
 	if {~ $args ()} {
@@ -300,6 +296,20 @@ fn-cd = { |dir|
 	}
 }
 
+#	hash lists the commands that %pathsearch has remembered, and
+#	hash -r makes it forget them, after installing a program earlier
+#	on $path than one of the same name that has already been found.
+
+fn-hash = { |*|
+	if {~ $#* 1 && ~ $1 -r} {
+		$&rehash
+	} else if {!~ $#* 0} {
+		throw error hash 'usage: hash [-r]'
+	} else {
+		for p <=$&pathcache {echo -- $p}
+	}
+}
+
 #	The vars function is provided for cultural compatibility with
 #	rc's whatis when used without arguments.  The option parsing
 #	is very primitive;  perhaps xs should provide a getopt-like
@@ -462,10 +472,9 @@ fn-%backquote = { |*|
 #	Note that %seq is also used for newline-separated commands within
 #	braces.  The logical operators are implemented in terms of if.
 #
-#	%and and %or are recursive, which is slightly inefficient given
-#	the current implementation of xs -- it is not properly tail recursive
-#	-- but that can be fixed and it's still better to write more of
-#	the shell in xs itself.
+#	%and and %or are recursive; since calls in tail position (including
+#	the branches of $&if and the last command of $&seq) don't nest in
+#	the interpreter, long chains run in constant stack.
 
 fn-%seq		= $&seq
 
@@ -755,11 +764,15 @@ EOF
 
 fn-%home	= $&home
 
-#	Path searching used to be a primitive, but the access function
-#	means that it can be written easier in xs.  It is not called for
-#	absolute path names or for functions.
+#	Path searching is done by a primitive which remembers where it
+#	found each command, until $path changes or a directory on it is
+#	modified.
+#	It is not called for absolute path names or for functions.  An
+#	equivalent in xs, which does no caching, would be
+#
+#		fn %pathsearch { |name| access -n $name -1e -xf $path }
 
-fn %pathsearch { |name| access -n $name -1e -xf $path }
+fn-%pathsearch	= $&pathsearch
 
 #	The exec-failure hook is called in the child if an exec() fails.
 #	A default version is provided (under conditional compilation) for
@@ -236,19 +236,28 @@ int Input::get() {
 	return c;
 }
 
+/* getcsignal -- readline's getc, giving up on an empty line on a signal */
+static int getcsignal(FILE *stream) {
+	if (!waitfd(fileno(stream), POLLIN)) {
+		rl_echo_signal_char(SIGINT);	/* the usual one, from ^C */
+		rl_replace_line("", 0);
+		rl_point = rl_mark = 0;
+		return EOF;
+	}
+	return rl_getc(stream);
+}
+
 /* callreadline -- readline wrapper */
 static char *callreadline() {
 	char *r;
 	rl_already_prompted = interrupted;
 	interrupted = false;
-	if (!xs_setjmp(slowlabel)) {
-		slow = true;
-		update_hist();
-		r = interrupted ?
-			NULL :
-			readline(continued_input ? prompt2 : prompt);
-	} else  r = NULL;
-	slow = false;
+	update_hist();
+	r = readline(continued_input ? prompt2 : prompt);
+	if (interrupted && r != NULL) {
+		free(r);
+		r = NULL;
+	}
 	if (r == NULL)
 		errno = EINTR;
 	SIGCHK();
@@ -270,7 +279,7 @@ static char * quote_func(char *text, int match_type, char *quote_pointer) {
 	char *pos;
 	if ((pos = strstr(text, "~/")) == text) {
 		/* Expand ~/... */
-		std::string home = varlookup("HOME", NULL)->term->str;
+		std::string home = getstr(varlookup("HOME", NULL)->term);
 		home += (pos + 1);
 		text = strdup(home.c_str());
 	} else if (strstr(text, "~") == text) {
@@ -354,9 +363,9 @@ static char ** get_completions(const char *text, int start, int end) {
 	     paths != NULL;
 	     paths = paths->next)
 	{
-		int l_path = strlen(paths->term->str);
+		int l_path = strlen(getstr(paths->term));
 		char *path = reinterpret_cast<char*>(ealloc(l_path + 2));
-		strcpy(path, paths->term->str);
+		strcpy(path, getstr(paths->term));
 		path[l_path] = '/';
 		path[l_path + 1] = '\0';
 
@@ -385,13 +394,13 @@ static char ** get_completions(const char *text, int start, int end) {
 			 * needs to free() the result
 			 */
 			results[result_p] =
-				strdup(simple_basename(i->term->str));
+				strdup(simple_basename(getstr(i->term)));
 		}
 	}
 
 	List* lvars = NULL;
-	foreach (Dict::value_type x, vars)
-		lvars = mklist(mkstr(gcdup(x.first.c_str())), lvars);
+	foreach (Symbol *sym, vars.sorted())
+		lvars = mkstrcell(sym->name, lvars);
 
 	/* Match (some) variables - can't easily match lexical/local because
          * that would require partially parsing/evaluating the input (which
@@ -517,7 +526,7 @@ extern Tree *parse(const char *pr1, const char *pr2) {
 	yylloc.first_line = yylloc.last_line = 1;
 
 	if (ISEOF(input))
-		throw mklist(mkstr("eof"), NULL);
+		throw mkstrcell("eof", NULL);
 
 	prompt = (pr1 == NULL) ? "" : pr1;
 	prompt2 = pr2;
@@ -561,7 +570,7 @@ extern const List *runinput(Input *in, int runflags) {
 					 + ((flags & run_noexec) ? 2 : 0)],
 			      NULL);
 		if (flags & eval_exitonfalse)
-			dispatch = mklist(mkstr("%exit-on-false"), dispatch);
+			dispatch = mkstrcell("%exit-on-false", dispatch);
 
 		Dyvar push("fn-%dispatch", dispatch);
 
@@ -738,6 +747,9 @@ extern void initinput(void) {
 	rl_attempted_completion_function = get_completions;
 	rl_change_environment = 0;
 	rl_prefer_env_winsize = 0;
+	/* a signal reaches catcher(), which ends the wait in getcsignal() */
+	rl_catch_signals = 0;
+	rl_getc_function = getcsignal;
 
 	/* initialize our view of the terminal size */
 	terminal_size();
@@ -12,9 +12,25 @@ extern List *mklist(Term* term, List* next) {
 	List* list = gcnew(List);
 	list->term = term;
 	list->next = next;
+	list->run = 1;
 	return list;
 }
 
+/* mklists -- make a list of n terms in one block, followed by next */
+extern List *mklists(Term **terms, int n, List *next) {
+	if (n == 0)
+		return next;
+	List *block = reinterpret_cast<List *>(galloc(n * sizeof (List)));
+	for (int i = 0; i < n; i++) {
+		assert(terms[i] != NULL);
+		block[i].term = terms[i];
+		block[i].next = &block[i + 1];
+		block[i].run = n - i;
+	}
+	block[n - 1].next = next;
+	return block;
+}
+
 /*
  * basic list manipulations
  */
@@ -27,23 +43,25 @@ extern List *reverse(List *list) {
 	do {
 		next = list->next;
 		list->next = prev;
+		list->run = 1;
 		prev = list;
 	} while ((list = next) != NULL);
 	return prev;
 }
 
-/* append -- merge two lists, non-destructively */
+/* append -- merge two lists, non-destructively; the copy is one block */
 extern List *append(const List* head, List* tail) {
-	List *lp, **prevp;
-
-	for (prevp = &lp; head; head = head->next) {
-		List *np = mklist(head->term, NULL);
-		*prevp = np;
-		prevp = &np->next;
+	int n = length(const_cast<List *>(head));
+	if (n == 0)
+		return tail;
+	List *block = reinterpret_cast<List *>(galloc(n * sizeof (List)));
+	for (int i = 0; i < n; i++, head = head->next) {
+		block[i].term = head->term;
+		block[i].next = &block[i + 1];
+		block[i].run = n - i;
 	}
-	*prevp = tail;
-
-	return lp;
+	block[n - 1].next = tail;
+	return block;
 }
 
 /* listcopy -- make a copy of a list */
@@ -54,30 +72,33 @@ extern List *listcopy(const List *list) {
 /* length -- lenth of a list */
 extern int length(List* list) {
 	int len = 0;
-	iterate (list) ++len;
+	for (; list != NULL; list = list[list->run - 1].next)
+		len += list->run;
 	return len;
 }
 
 /* listify -- turn an argc/argv vector into a list */
 extern List *listify(int argc, char **argv) {
-	List *list = NULL;
-	while (argc > 0) {
-		Term *term = mkstr(argv[--argc]);
-		list = mklist(term, list);
+	std::vector< Term *, gc_allocator<Term *> > terms;
+	for (int i = 0; i < argc; i++)
+		terms.push_back(mkstr(argv[i]));
+	return mklists(terms.data(), argc, NULL);
+}
+
+/* nthlist -- the list from the nth element on, indexed from 1 */
+extern List *nthlist(List *list, int n) {
+	assert(n > 0);
+	while (list != NULL && n > list->run) {
+		n -= list->run;
+		list = list[list->run - 1].next;
 	}
-	
-	return list;
+	return list == NULL ? NULL : &list[n - 1];
 }
 
 /* nth -- return nth element of a list, indexed from 1 */
 extern Term *nth(List *list, int n) {
-	assert(n > 0);
-	iterate (list) {
-		assert(list->term != NULL);
-		if (--n == 0)
-			return list->term;
-	}
-	return NULL;
+	list = nthlist(list, n);
+	return list == NULL ? NULL : list->term;
 }
 
 static List* clonelistnode(List *list) {
@@ -119,6 +140,7 @@ extern Vector* vectorize(const List* list) {
        iterate (list) {
                v->push_back(gcdup(getstr(list->term)));
        }
+       v->push_back(NULL);
 
        return v;
 }
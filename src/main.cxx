@@ -36,7 +36,7 @@ static void initpath(void) {
 
 /* initpid -- set $pid for this shell */
 static void initpid(void) {
-	vardef("pid", NULL, mklist(mkstr(str("%d", getpid())), NULL));
+	vardef("pid", NULL, mkstrcell(str("%d", getpid()), NULL));
 }
 
 /* runxsrc -- run the user's profile, if it exists */
@@ -229,12 +229,12 @@ getopt_done:
 				return 1;
 			}
 			vardef("*", NULL, listify(ac - optind, av + optind));
-			vardef("0", NULL, mklist(mkstr(file), NULL));
+			vardef("0", NULL, mkstrcell(file, NULL));
 			return exitstatus(runfd(fd, file, runflags));
 		}
 
 		vardef("*", NULL, listify(ac - optind, av + optind));
-		vardef("0", NULL, mklist(mkstr(av[0]), NULL));
+		vardef("0", NULL, mkstrcell(av[0], NULL));
 		if (cmd != NULL)
 			return exitstatus(runstring(cmd, NULL, runflags));
 		return exitstatus(runfd(0, "stdin", runflags));
@@ -1,8 +1,39 @@
 /* match.cxx -- pattern matching routines */
 
 #include "xs.hxx"
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
 
-enum { RANGE_FAIL = -1, RANGE_ERROR = -2 };
+/*
+ * compiled patterns
+ *	a pattern is compiled to a string of elements, each matching one
+ *	character (a literal, ?, or a class) or, for *, any run of them.
+ *	the stars cut it into segments of fixed length.  a string matches
+ *	if the first segment matches its start, the last segment its end,
+ *	and the others appear in order in between.  taking the leftmost
+ *	place for each segment in turn is never wrong, so the matcher does
+ *	not backtrack, and a pattern is read only once, when it's compiled.
+ */
+
+enum Elemkind { eChar, eAny, eClass, eStar };
+
+struct Elem {
+	Elemkind kind;
+	unsigned char c;		/* eChar */
+	const unsigned char *set;	/* eClass: a bit per character */
+};
+
+struct Pattern {
+	Elem *elems;
+	int nelems;
+	int *segs;		/* where each segment starts in elems */
+	int *lens;		/* and its length, not counting the star */
+	int nsegs;		/* one more than the number of stars */
+	int minlen;		/* the shortest string it can match */
+	bool wild;		/* any wildcards at all? */
+	const char *literal;	/* if not, the text to compare with */
+};
 
 /*
    From the ed(1) man pages (on ranges):
@@ -14,96 +45,392 @@ enum { RANGE_FAIL = -1, RANGE_ERROR = -2 };
 	if it is the first character (after an initial `^', if any), in
 	the bracketed string.
 
-   rangematch() matches a single character against a class, and returns
-   an integer offset to the end of the range on success, or -1 on
-   failure.
+   classset() reads a class after its [ into a set of characters, and
+   returns the length of the class (including the ]), or -1 if it is
+   never closed, in which case the [ is an ordinary character.
 */
 
-#define	ISQUOTED(q, n)	((q) == QUOTED || ((q) != UNQUOTED && (q)[n] == 'q'))
-#define TAILQUOTE(q, n) ((q) == UNQUOTED ? UNQUOTED : ((q) + (n)))
+#define	ISQUOTED(q, off, n)	isquoted(q, (off) + (n))
+#define	SETBIT(set, c)		((set)[(unsigned char) (c) >> 3] |= 1 << ((c) & 7))
+#define	INSET(set, c)		((set)[(unsigned char) (c) >> 3] & (1 << ((c) & 7)))
 
-/* rangematch -- match a character against a character class */
-static int rangematch(const char *p, const char *q, char c) {
+/* classset -- compile a character class */
+static int classset(const char *p, const Quote *q, int off,
+		    unsigned char *set) {
 	const char *orig = p;
-	bool neg;
-	bool matched = false;
-	if (*p == '~' && !ISQUOTED(q, 0)) {
-		p++, q++;
-	    	neg = true;
-	} else
-		neg = false;
-	if (*p == ']' && !ISQUOTED(q, 0)) {
-		p++, q++;
-		matched = (c == ']');
+	bool neg = false;
+	memzero(set, 32);
+	if (*p == '~' && !ISQUOTED(q, off, 0)) {
+		p++, off++;
+		neg = true;
+	}
+	if (*p == ']' && !ISQUOTED(q, off, 0)) {
+		p++, off++;
+		SETBIT(set, ']');
 	}
-	for (; *p != ']' || ISQUOTED(q, 0); p++, q++) {
+	for (; *p != ']' || ISQUOTED(q, off, 0); p++, off++) {
 		if (*p == '\0')
-			return RANGE_ERROR;	/* bad syntax */
-		if (p[1] == '-' && !ISQUOTED(q, 1) && ((p[2] != ']'
-                    && p[2] != '\0') || ISQUOTED(q, 2))) {
+			return -1;	/* bad syntax */
+		if (p[1] == '-' && !ISQUOTED(q, off, 1) && ((p[2] != ']'
+                    && p[2] != '\0') || ISQUOTED(q, off, 2))) {
 			/* check for [..-..] but ignore [..-] */
-			if (c >= *p && c <= p[2])
-				matched = true;
+			for (int c = 1; c < 256; c++)
+				if ((char) c >= *p && (char) c <= p[2])
+					SETBIT(set, c);
 			p += 2;
-			q += 2;
-		} else if (*p == c)
-			matched = true;
+			off += 2;
+		} else
+			SETBIT(set, *p);
 	}
-	if (matched ^ neg)
-		return p - orig + 1; /* skip the right-bracket */
-	else
-		return RANGE_FAIL;
+	if (neg)
+		for (int i = 0; i < 32; i++)
+			set[i] = ~set[i];
+	return p - orig + 1; /* skip the right-bracket */
 }
 
-/* match -- match a single pattern against a single string. */
-extern bool match(const char *s, const char *p, const char *q) {
-	if (q == QUOTED) return streq(s, p);
-	for (int i = 0 ;;) {
-		int c = p[i++];
-		if (c == '\0')
-			return *s == '\0';
-		else if (q == UNQUOTED || q[i - 1] == 'r') {
-			switch (c) {
-			case '?':
-				if (*s++ == '\0') return false;
+/* compile -- turn a pattern into elements and segments */
+static Pattern *compile(const char *p, const Quote *q) {
+	Pattern *pat = gcnew(Pattern);
+	size_t len = strlen(p);
+	pat->elems = reinterpret_cast<Elem *>(galloc((len + 1) * sizeof (Elem)));
+	pat->nelems = 0;
+	pat->wild = false;
+	int nstars = 0;
+	for (size_t i = 0; i < len;) {
+		Elem *e = &pat->elems[pat->nelems++];
+		e->kind = eChar;
+		e->c = p[i];
+		e->set = NULL;
+		if (ISQUOTED(q, 0, i)) {
+			i++;
+			continue;
+		}
+		switch (p[i++]) {
+		case '?':
+			e->kind = eAny;
+			pat->wild = true;
+			break;
+		case '*':
+			e->kind = eStar;
+			pat->wild = true;
+			++nstars;
+			break;
+		case '[': {
+			unsigned char *set =
+				reinterpret_cast<unsigned char *>(galloc_atomic(32));
+			int j = classset(p + i, q, i, set);
+			if (j < 0)
 				break;
-			case '*':
-				while (p[i] == '*'
-                                       && (q == UNQUOTED || q[i] == 'r'))
-                                        // collapse multiple stars
-					i++;
-				if (p[i] == '\0')
-                                        /* star at end of pattern? */
-					return true;
-				while (*s != '\0')
-					if (match(s++, p + i, TAILQUOTE(q, i)))
-						return true;
+			e->kind = eClass;
+			e->set = set;
+			pat->wild = true;
+			i += j;
+			break;
+		}
+		}
+	}
+	pat->literal = pat->wild ? NULL : gcdup(p);
+
+	pat->nsegs = nstars + 1;
+	pat->minlen = pat->nelems - nstars;
+	pat->segs = reinterpret_cast<int *>(galloc_atomic(pat->nsegs * sizeof (int)));
+	pat->lens = reinterpret_cast<int *>(galloc_atomic(pat->nsegs * sizeof (int)));
+	for (int i = 0, k = 0; k < pat->nsegs; k++) {
+		pat->segs[k] = i;
+		while (i < pat->nelems && pat->elems[i].kind != eStar)
+			i++;
+		pat->lens[k] = i - pat->segs[k];
+		i++;
+	}
+	return pat;
+}
+
+/* segmatch -- does a segment match the n characters at s? */
+static bool segmatch(const Elem *e, int n, const char *s) {
+	for (int i = 0; i < n; i++, e++) {
+		unsigned char c = s[i];
+		switch (e->kind) {
+		case eChar:
+			if (c != e->c)
 				return false;
-			case '[': {
-				if (*s == '\0')
-					return false;
-				int j;
-				switch (j = rangematch(p + i,
-                                                       TAILQUOTE(q, i), *s)) {
-				default:
-					i += j;
-					break;
-				case RANGE_FAIL:
-					return false;
-				case RANGE_ERROR:
-					if (*s != '[')
-						return false;
-				}
-				s++;
-				break;
-			}
-			default:
-				if (c != *s++)
+			break;
+		case eClass:
+			if (!INSET(e->set, c))
+				return false;
+			break;
+		default:
+			break;
+		}
+	}
+	return true;
+}
+
+/* run -- match a compiled pattern, noting where each segment was found */
+static bool run(const Pattern *pat, const char *s, int *found) {
+	int len = strlen(s), last = pat->nsegs - 1;
+	const Elem *e = pat->elems;
+	if (last == 0)
+		return len == pat->lens[0] && segmatch(e, len, s);
+
+	/* the fixed ends first, as a cheap test before any searching */
+	int head = pat->lens[0], tail = pat->lens[last];
+	if (len < head + tail
+	    || !segmatch(e, head, s)
+	    || !segmatch(e + pat->segs[last], tail, s + len - tail))
+		return false;
+	found[0] = 0;
+	found[last] = len - tail;
+
+	int pos = head, end = len - tail;
+	for (int k = 1; k < last; k++) {
+		const Elem *seg = e + pat->segs[k];
+		int n = pat->lens[k];
+		for (;; pos++) {
+			if (pos + n > end)
+				return false;
+			if (n > 0 && seg->kind == eChar) {
+				const char *c = reinterpret_cast<const char *>(
+					memchr(s + pos, seg->c, end - n + 1 - pos));
+				if (c == NULL)
 					return false;
+				pos = c - s;
 			}
-		} else if (c != *s++)
+			if (segmatch(seg, n, s + pos))
+				break;
+		}
+		found[k] = pos;
+		pos += n;
+	}
+	return true;
+}
+
+/* patternmatch -- does a compiled pattern match a string? */
+extern bool patternmatch(const Pattern *pat, const char *s) {
+	if (pat->literal != NULL)
+		return streq(s, pat->literal);
+	int buf[16];
+	int *found = pat->nsegs <= 16
+		? buf
+		: reinterpret_cast<int *>(galloc_atomic(pat->nsegs * sizeof (int)));
+	return run(pat, s, found);
+}
+
+/* extract -- the wildcarded parts of a string matched by a pattern */
+static List *extract(const Pattern *pat, const char *s) {
+	std::vector<int> found(pat->nsegs);
+	if (!pat->wild || !run(pat, s, &found[0]))
+		return NULL;
+	std::vector< Term *, gc_allocator<Term *> > parts;
+	for (int k = 0; k < pat->nsegs; k++) {
+		const Elem *seg = pat->elems + pat->segs[k];
+		for (int i = 0; i < pat->lens[k]; i++)
+			if (seg[i].kind != eChar)
+				parts.push_back(mkstr(str("%c", s[found[k] + i])));
+		if (k + 1 < pat->nsegs) {
+			int begin = found[k] + pat->lens[k];
+			parts.push_back(mkstr(gcndup(s + begin,
+						     found[k + 1] - begin)));
+		}
+	}
+	return mklists(&parts[0], parts.size(), NULL);
+}
+
+
+/*
+ * the pattern cache
+ *	patterns are kept by their text and quoting, so that a pattern
+ *	used again, as in a loop or a matcher, is only compiled once.
+ */
+
+enum { MAXPATTERNS = 1024 };	/* forget everything past this many */
+
+struct Patkey {
+	const char *s;
+	const Quote *q;
+};
+
+struct Patkeyhash {
+	size_t operator()(const Patkey &k) const {
+		size_t h = strhash(k.s);
+		if (k.q != QUOTED && k.q != UNQUOTED)
+			for (int i = 0; i < k.q->n; i++)
+				h = h * 31 + k.q->end[i];
+		return h ^ (k.q == UNQUOTED);
+	}
+};
+
+struct Patkeyeq {
+	bool operator()(const Patkey &a, const Patkey &b) const {
+		if (!streq(a.s, b.s))
 			return false;
+		if (a.q == b.q)
+			return true;
+		if (a.q == QUOTED || a.q == UNQUOTED
+		    || b.q == QUOTED || b.q == UNQUOTED || a.q->n != b.q->n)
+			return false;
+		return memcmp(a.q->end, b.q->end, a.q->n * sizeof (int)) == 0;
 	}
+};
+
+typedef std::unordered_map<Patkey, Pattern *, Patkeyhash, Patkeyeq,
+	traceable_allocator< std::pair<const Patkey, Pattern *> > >
+	Patterns;
+
+static Patterns patterns;
+
+/* compilepattern -- the compiled form of a pattern, from the cache if we can */
+extern Pattern *compilepattern(const char *s, const Quote *q) {
+	Patkey key = { s, q };
+	Patterns::iterator i = patterns.find(key);
+	if (i != patterns.end())
+		return i->second;
+	Pattern *pat = compile(s, q);
+	if (patterns.size() >= MAXPATTERNS)
+		patterns.clear();
+	key.s = gcdup(s);
+	if (q != QUOTED && q != UNQUOTED) {
+		size_t size = offsetof(Quote, end) + q->n * sizeof (int);
+		Quote *copy = reinterpret_cast<Quote *>(galloc_atomic(size));
+		memcpy(copy, q, size);
+		key.q = copy;
+	}
+	patterns[key] = pat;
+	return pat;
+}
+
+
+/*
+ * pattern sets
+ *	to test a string against several patterns at once, the first and
+ *	last characters of the string are looked up in tables built from
+ *	all the patterns, and the two masks found there leave only the
+ *	patterns that could match.  those are run in order, so the first
+ *	to match is the one reported.  sets are cached by their patterns.
+ */
+
+enum {
+	MAXSETS = 256,		/* forget everything past this many */
+	SETMIN = 8		/* with fewer pairs to try, just try them */
+};
+
+struct Patternset {
+	Pattern **pats;
+	int npats;
+	int nwords;		/* 64-bit words in each mask */
+	uint64_t *first;	/* per character, the patterns that may start with it */
+	uint64_t *last;		/* and those that may end with it */
+};
+
+struct Setkey {
+	Pattern **pats;
+	int npats;
+};
+
+struct Setkeyhash {
+	size_t operator()(const Setkey &k) const {
+		size_t h = k.npats;
+		for (int i = 0; i < k.npats; i++)
+			h = h * 31 + reinterpret_cast<uintptr_t>(k.pats[i]);
+		return h;
+	}
+};
+
+struct Setkeyeq {
+	bool operator()(const Setkey &a, const Setkey &b) const {
+		return a.npats == b.npats
+		    && memcmp(a.pats, b.pats, a.npats * sizeof (Pattern *)) == 0;
+	}
+};
+
+typedef std::unordered_map<Setkey, Patternset *, Setkeyhash, Setkeyeq,
+	traceable_allocator< std::pair<const Setkey, Patternset *> > >
+	Patternsets;
+
+static Patternsets patternsets;
+
+/* accepts -- could the element match the character? no element means yes */
+static bool accepts(const Elem *e, unsigned char c) {
+	if (e == NULL)
+		return true;
+	switch (e->kind) {
+	case eChar:	return c == e->c;
+	case eClass:	return INSET(e->set, c);
+	default:	return true;
+	}
+}
+
+/* mkset -- build the tables for a list of compiled patterns */
+static Patternset *mkset(Pattern **pats, int npats) {
+	Patternset *set = gcnew(Patternset);
+	set->pats = reinterpret_cast<Pattern **>(galloc(npats * sizeof (Pattern *)));
+	memcpy(set->pats, pats, npats * sizeof (Pattern *));
+	set->npats = npats;
+	set->nwords = (npats + 63) / 64;
+	size_t size = 256 * set->nwords * sizeof (uint64_t);
+	set->first = reinterpret_cast<uint64_t *>(galloc_atomic(size));
+	set->last = reinterpret_cast<uint64_t *>(galloc_atomic(size));
+	memzero(set->first, size);
+	memzero(set->last, size);
+	for (int i = 0; i < npats; i++) {
+		const Pattern *pat = pats[i];
+		const Elem *head = NULL, *tail = NULL;
+		if (pat->nelems > 0 && pat->elems[0].kind != eStar)
+			head = &pat->elems[0];
+		if (pat->nelems > 0 && pat->elems[pat->nelems - 1].kind != eStar)
+			tail = &pat->elems[pat->nelems - 1];
+		uint64_t bit = (uint64_t) 1 << (i % 64);
+		for (int c = 0; c < 256; c++) {
+			if (accepts(head, c))
+				set->first[c * set->nwords + i / 64] |= bit;
+			if (accepts(tail, c))
+				set->last[c * set->nwords + i / 64] |= bit;
+		}
+	}
+	return set;
+}
+
+/*
+ * compileset -- the set of a list of patterns, from the cache if we can;
+ *	for extraction, the patterns without wildcards are left out
+ */
+static Patternset *compileset(List *patterns, QuoteList *quotes, bool wildonly) {
+	std::vector< Pattern *, gc_allocator<Pattern *> > pats;
+	for (; patterns != NULL; patterns = patterns->next, quotes = quotes->next) {
+		Pattern *pat = compilepattern(getstr(patterns->term), quotes->quote);
+		if (pat->wild || !wildonly)
+			pats.push_back(pat);
+	}
+	Setkey key = { pats.empty() ? NULL : &pats[0], (int) pats.size() };
+	Patternsets::iterator i = patternsets.find(key);
+	if (i != patternsets.end())
+		return i->second;
+	Patternset *set = mkset(key.pats, key.npats);
+	if (patternsets.size() >= MAXSETS)
+		patternsets.clear();
+	key.pats = set->pats;
+	patternsets[key] = set;
+	return set;
+}
+
+/* setmatch -- the index of the first pattern in a set to match s, or -1 */
+static int setmatch(const Patternset *set, const char *s) {
+	size_t len = strlen(s);
+	const uint64_t *first = set->first + (unsigned char) s[0] * set->nwords;
+	const uint64_t *last = set->last
+		+ (unsigned char) s[len == 0 ? 0 : len - 1] * set->nwords;
+	for (int w = 0; w < set->nwords; w++)
+		for (uint64_t m = first[w] & last[w]; m != 0; m &= m - 1) {
+			const Pattern *pat = set->pats[w * 64 + __builtin_ctzll(m)];
+			if ((size_t) pat->minlen <= len && patternmatch(pat, s))
+				return w * 64 + __builtin_ctzll(m);
+		}
+	return -1;
+}
+
+/* match -- match a single pattern against a single string. */
+extern bool match(const char *s, const char *p, const Quote *q) {
+	if (q == QUOTED) return streq(s, p);
+	return patternmatch(compilepattern(p, q), s);
 }
 
 
@@ -115,21 +442,19 @@ extern bool match(const char *s, const char *p, const char *q) {
  *	() matches (), but otherwise null patterns match nothing.
  */
 
-extern bool listmatch(List* subject, List* pattern, StrList* quote) {
+extern bool listmatch(List* subject, List* pattern, QuoteList* quote) {
 	if (subject == NULL) {
 		if (pattern == NULL)
 			return true;
 		for (; pattern; pattern = pattern->next, quote = quote->next) {
 			/* one or more stars match null */
-			const char *pw = getstr(pattern->term),
-						*qw = quote->str;
+			const char *pw = getstr(pattern->term);
+			const Quote *qw = quote->quote;
 			if (*pw != '\0' && qw != QUOTED) {
 				int i;
 				bool matched = true;
 				for (i = 0; pw[i] != '\0'; i++)
-					if (pw[i] != '*'
-					    || (qw != UNQUOTED
-						&& qw[i] != 'r')) {
+					if (pw[i] != '*' || isquoted(qw, i)) {
 						matched = false;
 						break;
 					}
@@ -139,88 +464,33 @@ extern bool listmatch(List* subject, List* pattern, StrList* quote) {
 			}
 		}
 		return false;
-	} else {
+	} else if (length(subject) * length(pattern) < SETMIN) {
 		for (; pattern; pattern = pattern->next, quote = quote->next) {
-			assert(quote != NULL);
-			assert(pattern->term != NULL);
-			assert(quote->str != NULL);
-			const char* pw = getstr(pattern->term);
-			const char* qw = quote->str;
-			List* t = subject;
-			for (; t != NULL; t = t->next) {
-				const char* tw = getstr(t->term);
-				if (match(tw, pw, qw)) {
-					return true;
-				}
+			const char *pw = getstr(pattern->term);
+			const Quote *qw = quote->quote;
+			List *t = subject;
+			if (qw == QUOTED) {
+				for (; t != NULL; t = t->next)
+					if (streq(getstr(t->term), pw))
+						return true;
+				continue;
 			}
+			/* compile once for all the subjects */
+			Pattern *pat = compilepattern(pw, qw);
+			for (; t != NULL; t = t->next)
+				if (patternmatch(pat, getstr(t->term)))
+					return true;
 		}
 		return false;
+	} else {
+		Patternset *set = compileset(pattern, quote, false);
+		for (; subject != NULL; subject = subject->next)
+			if (setmatch(set, getstr(subject->term)) >= 0)
+				return true;
+		return false;
 	}
 }
 
-/*
- * extractsinglematch -- extract matching parts of a single subject and a
- *			 single pattern, returning it backwards
- */
-
-static List *extractsinglematch(const char *subject, const char *pattern,
-				const char *quoting, List *result) {
-	int i;
-	const char *s;
-
-	if (!haswild(pattern, quoting) /* no wildcards, so no matches */
-	    || !match(subject, pattern, quoting))
-		return NULL;
-
-	for (s = subject, i = 0; pattern[i] != '\0'; s++) {
-		if (ISQUOTED(quoting, i))
-			i++;
-		else {
-			int c = pattern[i++];
-			switch (c) {
-			    case '*': {
-				const char *begin;
-				if (pattern[i] == '\0')
-					return mklist(mkstr(gcdup(s)), result);
-				for (begin = s;; s++) {
-					const char *q = TAILQUOTE(quoting, i);
-					assert(*s != '\0');
-					if (match(s, pattern + i, q)) {
-						result = mklist(mkstr(
-							gcndup(begin,
-							       s - begin)),
-							result);
-						return haswild(pattern + i, q)
-							? extractsinglematch(
-								s, pattern+i,
-								q, result)
-							: result;
-					}
-				}
-			    }
-			    case '[': {
-				int j = rangematch(pattern + i,
-						   TAILQUOTE(quoting, i), *s);
-				assert(j != RANGE_FAIL);
-				if (j == RANGE_ERROR) {
-					assert(*s == '[');
-					break;
-				}
-				i += j;
-			    }
-			    /* FALLTHROUGH */
-			    case '?':
-				result = mklist(mkstr(str("%c", *s)), result);
-				break;
-			    default:
-				break;
-			}
-		}
-	}
-
-	return result;
-}
-
 /*
  * extractmatches
  *
@@ -229,33 +499,25 @@ static List *extractsinglematch(const char *subject, const char *pattern,
  *	subjects as the result.
  */
 
-extern List *extractmatches(List *subjects, List *patterns, StrList *quotes) {
+extern List *extractmatches(List *subjects, List *patterns, QuoteList *quotes) {
+	Patternset *set = compileset(patterns, quotes, true);
+
 	List *result;
 	List **prevp = &result;
 	int matched = 0;
 
 	for (List *subject = subjects; subject != NULL;
 	     subject = subject->next) {
-		List *pattern;
-		StrList *quote;
-		for (pattern = patterns, quote = quotes;
-		     pattern != NULL;
-		     pattern = pattern->next, quote = quote->next) {
-			List *match;
-			const char *pat = getstr(pattern->term);
-			match = extractsinglematch(getstr(subject->term),
-						   pat, quote->str, NULL);
-			if (match != NULL) {
-				/* match is returned backwards; reverse it */
-				match = reverse(match);
-				for (*prevp = match; match != NULL;
-				     match = *prevp)
-					prevp = &match->next;
-				matched = 1;
-				break;
-			}
-		}
+		const char *s = getstr(subject->term);
+		int i = setmatch(set, s);
+		if (i < 0)
+			continue;
+		List *match = extract(set->pats[i], s);
+		for (*prevp = match; match != NULL; match = *prevp)
+			prevp = &match->next;
+		matched = 1;
 	}
 
+	*prevp = NULL;
 	return matched ? result : NULL;
 }
@@ -0,0 +1,259 @@
+/* parsecache.cxx -- closures parsed from strings, kept by text */
+
+#define	REQUIRE_STAT	1
+
+#include "xs.hxx"
+#include <fcntl.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <string>
+
+/*
+ * a closure that has been through a string (a function imported from the
+ * environment, or a %closure term) is parsed once per process, and the
+ * result is shared by every term with the same text.  if $XS_PARSE_CACHE
+ * names a file, the parse trees are also kept there, keyed by a hash of
+ * their text, so that later runs of xs can skip the parser.
+ */
+
+struct Strhash {
+	size_t operator()(const char *s) const { return strhash(s); }
+};
+
+struct Streq {
+	bool operator()(const char *a, const char *b) const { return streq(a, b); }
+};
+
+typedef std::unordered_map<const char *, Closure *, Strhash, Streq,
+	traceable_allocator< std::pair<const char * const, Closure *> > >
+	Closures;
+
+static Closures closures;
+
+enum {
+	MAXCLOSURES = 4096,	/* forget everything past this many */
+	MAXDISK = 1 << 20	/* stop adding to the file past this size */
+};
+
+
+/*
+ * the on-disk cache
+ *	the file is a magic line followed by records, each made of its own
+ *	length, the hash and text of a closure, and its tree in prefix order:
+ *	a kind byte (NOKIND for a null pointer), then a string or children.
+ *	the magic line holds FORMAT and a hash of the node shapes, and a
+ *	file written by a shell with other trees is started afresh.
+ */
+
+enum {
+	FORMAT = 2,	/* bump when node kinds, their shapes or the grammar change */
+	NOKIND = 0xff
+};
+static const char PREFIX[] = "xs parse cache ";
+static std::string magic;	/* the prefix, version and shape of trees */
+
+static bool diskchecked = false;
+static bool diskstale = false;	/* the file is from another version; replace it */
+static const char *diskfile = NULL;
+static char *disk = NULL;
+static size_t disklen = 0;
+static std::unordered_multimap<unsigned long, size_t> diskindex;
+
+static bool hasstring(int kind) {
+	return kind == nWord || kind == nQword || kind == nPrim
+	    || kind == nInt || kind == nFloat;
+}
+
+static bool haschild(int kind) {
+	return kind == nCall || kind == nThunk || kind == nVar || kind == nArith
+	    || kind == nNegate || kind == nCount;
+}
+
+/* encode -- append a tree to buf; false if it can't be represented */
+static bool encode(Tree *tree, std::string &buf) {
+	if (tree == NULL) {
+		buf += (char) NOKIND;
+		return true;
+	}
+	int kind = tree->kind;
+	buf += (char) kind;
+	if (hasstring(kind)) {
+		buf.append(tree->u[0].s, strlen(tree->u[0].s) + 1);
+		return true;
+	}
+	if (kind == nPipe)
+		return false;
+	if (!encode(tree->u[0].p, buf))
+		return false;
+	return haschild(kind) || encode(tree->u[1].p, buf);
+}
+
+/* decode -- rebuild a tree from [*sp, end); false if it's malformed */
+static bool decode(const char **sp, const char *end, Tree **result) {
+	const char *s = *sp;
+	if (s >= end)
+		return false;
+	int kind = (unsigned char) *s++;
+	if (kind == NOKIND) {
+		*sp = s;
+		*result = NULL;
+		return true;
+	}
+	if (kind > nRedir)
+		return false;
+	if (hasstring(kind)) {
+		const char *nul = reinterpret_cast<const char *>(memchr(s, '\0', end - s));
+		if (nul == NULL)
+			return false;
+		*sp = nul + 1;
+		*result = mk(kind, gcdup(s));
+		return true;
+	}
+	Tree *left, *right = NULL;
+	if (!decode(&s, end, &left))
+		return false;
+	if (haschild(kind))
+		*result = mk(kind, left);
+	else {
+		if (!decode(&s, end, &right))
+			return false;
+		*result = mk(kind, left, right);
+	}
+	*sp = s;
+	return true;
+}
+
+/* shapes -- a hash of which node kinds hold strings and which one child */
+static unsigned long shapes() {
+	unsigned long hash = nPipe;
+	for (int kind = 0; kind <= nPipe; kind++)
+		hash = hash * 31 + (hasstring(kind) ? 1 : 0) + (haschild(kind) ? 2 : 0);
+	return hash;
+}
+
+/* diskload -- read the cache file, if there is one, and index its records */
+static void diskload() {
+	diskchecked = true;
+	magic = str("%s%d %lx\n", PREFIX, FORMAT, shapes());
+	const char *file = getenv("XS_PARSE_CACHE");
+	if (file == NULL || *file == '\0')
+		return;
+	diskfile = gcdup(file);
+
+	int fd = open(file, O_RDONLY);
+	if (fd == -1)
+		return;
+	struct stat st;
+	if (fstat(fd, &st) == -1 || st.st_size > 2 * MAXDISK) {
+		close(fd);
+		diskfile = NULL;
+		return;
+	}
+	disk = reinterpret_cast<char *>(galloc_atomic(st.st_size + 1));
+	ssize_t n = read(fd, disk, st.st_size);
+	close(fd);
+	if (n < (ssize_t) magic.size()
+	    || memcmp(disk, magic.data(), magic.size()) != 0) {
+		if (n >= (ssize_t) (sizeof PREFIX - 1)
+		    && memcmp(disk, PREFIX, sizeof PREFIX - 1) == 0)
+			diskstale = true;
+		else if (n != 0)	/* not ours; leave it alone */
+			diskfile = NULL;
+		disk = NULL;
+		return;
+	}
+	disklen = n;
+
+	/* index the records; a torn or foreign record ends the file */
+	size_t off = magic.size();
+	for (;;) {
+		uint32_t len;
+		unsigned long hash;
+		if (off + sizeof len + sizeof hash > disklen)
+			break;
+		memcpy(&len, disk + off, sizeof len);
+		if (len < sizeof hash || off + sizeof len + len > disklen)
+			break;
+		memcpy(&hash, disk + off + sizeof len, sizeof hash);
+		diskindex.insert(std::make_pair(hash, off));
+		off += sizeof len + len;
+	}
+}
+
+/* diskfind -- the tree cached on disk for text s, or NULL */
+static Tree *diskfind(const char *s, unsigned long hash) {
+	if (!diskchecked)
+		diskload();
+	if (disk == NULL)
+		return NULL;
+	size_t slen = strlen(s) + 1;
+	auto range = diskindex.equal_range(hash);
+	for (auto i = range.first; i != range.second; ++i) {
+		uint32_t len;
+		memcpy(&len, disk + i->second, sizeof len);
+		const char *rec = disk + i->second + sizeof len + sizeof hash;
+		const char *end = disk + i->second + sizeof len + len;
+		if ((size_t) (end - rec) < slen || memcmp(rec, s, slen) != 0)
+			continue;
+		Tree *tree;
+		const char *p = rec + slen;
+		if (decode(&p, end, &tree) && p == end)
+			return tree;
+	}
+	return NULL;
+}
+
+/* diskadd -- append the tree for text s to the cache file */
+static void diskadd(const char *s, unsigned long hash, Tree *tree) {
+	if (diskfile == NULL)
+		return;
+	std::string rec(sizeof (uint32_t), '\0');
+	rec.append(reinterpret_cast<const char *>(&hash), sizeof hash);
+	rec.append(s, strlen(s) + 1);
+	if (!encode(tree, rec))
+		return;
+	uint32_t len = rec.size() - sizeof len;
+	memcpy(&rec[0], &len, sizeof len);
+
+	int fd = open(diskfile, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC
+			      | (diskstale ? O_TRUNC : 0), 0666);
+	if (fd == -1)
+		return;
+	/* other shells append too, so the file, not disklen, says when to stop */
+	struct stat st;
+	if (fstat(fd, &st) == -1 || st.st_size > MAXDISK) {
+		close(fd);
+		diskfile = NULL;
+		return;
+	}
+	if (st.st_size == 0)
+		rec.insert(0, magic);
+	/* one write, so that concurrent shells append whole records */
+	if (write(fd, rec.data(), rec.size()) == (ssize_t) rec.size())
+		diskstale = false;
+	close(fd);
+}
+
+
+/* parseclosure -- the closure for the text of a term, or NULL */
+extern Closure *parseclosure(const char *s) {
+	Closures::iterator i = closures.find(s);
+	if (i != closures.end())
+		return i->second;
+
+	unsigned long hash = strhash(s);
+	Tree *np = diskfind(s, hash);
+	if (np == NULL) {
+		np = parsestring(s);
+		if (np == NULL)
+			return NULL;
+		diskadd(s, hash, np);
+	}
+
+	/* extractbindings() rearranges the tree, so it must come last */
+	Closure *closure = extractbindings(np);
+	if (closures.size() >= MAXCLOSURES)
+		closures.clear();
+	closures[gcdup(s)] = closure;
+	return closure;
+}
@@ -5,13 +5,11 @@
 
 PRIM(seq) {
 	(void)binding;
-	const List* result = ltrue;
-	iterate(list)
-		result = eval1(list->term, evalflags &~ 
-			(list->next == NULL 
-			? 0 
-			: eval_inchild));
-	return result;
+	if (list == NULL)
+		return ltrue;
+	for (; list->next != NULL; list = list->next)
+		eval1(list->term, evalflags &~ eval_inchild);
+	return tailcall(mklist(list->term, NULL), NULL);
 }
 
 PRIM(if) {
@@ -23,7 +21,7 @@ PRIM(if) {
 		if (list == NULL)
 			return cond;
                 else if (istrue(cond))
-			return eval1(list->term, evalflags);
+			return tailcall(mklist(list->term, NULL), NULL);
 	}
 	return ltrue;
 }
@@ -183,7 +183,7 @@ PRIM(echo) {
 PRIM(count) {
 	(void)binding;
 	(void)evalflags;
-	return mklist(mkstr(str("%d", length(list))), NULL);
+	return mkintcell(length(list), NULL);
 }
 
 PRIM(setnoexport) {
@@ -197,14 +197,14 @@ PRIM(version) {
 	(void)list;
 	(void)binding;
 	(void)evalflags;
-	return mklist(mkstr((char *) version), NULL);
+	return mkstrcell((char *) version, NULL);
 }
 
 PRIM(build) {
 	(void)list;
 	(void)binding;
 	(void)evalflags;
-	return mklist(mkstr((char *) build), NULL);
+	return mkstrcell((char *) build, NULL);
 }
 
 PRIM(exec) {
@@ -238,7 +238,7 @@ PRIM(dot) {
 	if (fd == -1)
 		fail("$&dot", "%s: %s", file, xsstrerror(errno));
 
-	Dyvar zero("0", mklist(mkstr(file), NULL));
+	Dyvar zero("0", mkstrcell(file, NULL));
 	Dyvar star("*", lp);
 
 	return runfd(fd, file, runflags);
@@ -250,7 +250,7 @@ PRIM(flatten) {
 	if (list == NULL)
 		fail("$&flatten", "usage: $&flatten separator [args ...]");
 	const char *sep = getstr(list->term);
-	list = mklist(mkstr(str("%L", list->next, sep)), NULL);
+	list = mkstrcell(str("%L", list->next, sep), NULL);
 	return list;
 }
 
@@ -389,7 +389,7 @@ PRIM(parse) {
 	tree = parse(mzwcs(prompt1), mzwcs(prompt2));
 	result = (tree == NULL)
 		   ? NULL
-		   : mklist(mkterm(NULL, mkclosure(mk(nThunk, tree), NULL)),
+		   : mktermcell(NULL, mkclosure(mk(nThunk, tree), NULL),
 			    NULL);
 	return result;
 }
@@ -451,7 +451,7 @@ PRIM(home) {
 	if (list->next != NULL)
 		fail("$&home", "usage: $&home [user]");
 	pw = getpwnam(getstr(list->term));
-	return (pw == NULL) ? NULL : mklist(mkstr(gcdup(pw->pw_dir)), NULL);
+	return (pw == NULL) ? NULL : mkstrcell(gcdup(pw->pw_dir), NULL);
 }
 
 PRIM(vars) {
@@ -519,7 +519,7 @@ PRIM(random) {
 	(void)list;
 	(void)binding;
 	(void)evalflags;
-	return mklist(mkstr(str("%d", random())), NULL);
+	return mkstrcell(str("%d", random()), NULL);
 }
 
 PRIM(len) {
@@ -533,7 +533,7 @@ PRIM(len) {
 		size_t n = mbstowcs(NULL, getstr(list->term), 0);
 		if (n == (size_t)-1)
 			fail("$&len", "invalid character");
-		Term *elt = mkstr(str("%ld", n, 0));
+		Term *elt = mkint(n);
 		if (!result) {result = mklist(elt, NULL); tail = result;}
 		else tail = tail->next = mklist(elt, NULL);
 		list = list->next;
@@ -564,6 +564,40 @@ PRIM(wid) {
 	return result;
 }
 
+PRIM(wildmatch) {
+	(void)binding;
+	(void)evalflags;
+	char *s;
+	if (list == NULL)
+		fail("$&wildmatch", "usage: $&wildmatch count wildcards... subjects...");
+	long n = strtol(getstr(list->term), &s, 10);
+	if (n < 0 || *s != '\0')
+		fail("$&wildmatch", "usage: $&wildmatch count wildcards... subjects...");
+	std::vector< Pattern *, gc_allocator<Pattern *> > pats;
+	for (list = list->next; n > 0; n--, list = list->next) {
+		if (list == NULL)
+			fail("$&wildmatch", "usage: $&wildmatch count wildcards... subjects...");
+		pats.push_back(compilepattern(getstr(list->term), UNQUOTED));
+	}
+	for (; list != NULL; list = list->next) {
+		const char *subject = getstr(list->term);
+		for (Pattern *pat : pats)
+			if (patternmatch(pat, subject))
+				return ltrue;
+	}
+	return lfalse;
+}
+
+/* matcher -- a function that tests its arguments against a list of wildcards */
+PRIM(matcher) {
+	(void)binding;
+	(void)evalflags;
+	static const char body[] = "{|*| $&wildmatch $#wildcards $wildcards $*}";
+	Closure *c = parseclosure(body);
+	return mktermcell(NULL, mkclosure(c->tree, mkbinding("wildcards", list, NULL)),
+			  NULL);
+}
+
 
 /*
  * initialization
@@ -598,6 +632,8 @@ extern void initprims_etc(Prim_dict& primdict) {
 	X(random);
 	X(len);
 	X(wid);
+	X(wildmatch);
+	X(matcher);
 	X(resetterminal);
 	X(printf);
 }
@@ -3,12 +3,11 @@
 #include "xs.hxx"
 #include "prim.hxx"
 #include <stdio.h>
-#include <sstream>
 #include <string.h>
 #include <termios.h>
 #include <unistd.h>
+#include <fcntl.h>
 
-using std::stringstream;
 
 static const char *caller;
 
@@ -97,10 +96,9 @@ PRIM(openfile) {
 	caller = "$&openfile";
 	if (length(list) != 4)
 		argcount("%openfile mode fd file cmd");
-	/* transpose the first two elements */
-	List* lp = list->next;
-	list->next = lp->next;
-	lp->next = list;
+	/* transpose the first two elements; the list may be shared */
+	List* lp = mklist(list->next->term,
+			  mklist(list->term, list->next->next));
 	return redir(redir_openfile, lp, evalflags);
 }
 
@@ -297,7 +295,7 @@ PRIM(readfrom) {
 	}
 
 	close(p[1]);
-	list = mklist(mkstr(str(DEVFD_PATH, p[0])), NULL);
+	list = mkstrcell(str(DEVFD_PATH, p[0]), NULL);
         const List *result;
 
 	try {
@@ -343,7 +341,7 @@ PRIM(writeto) {
 	}
 
 	close(p[0]);
-	list = mklist(mkstr(str(DEVFD_PATH, p[1])), NULL);
+	list = mkstrcell(str(DEVFD_PATH, p[1]), NULL);
         const List *result;
 	try {
 		Dyvar push(var, list);
@@ -360,16 +358,37 @@ PRIM(writeto) {
 	return result;
 }
 
-#define	BUFSIZE	4096
+/*
+ * a backquote reads the whole output of its command into one buffer, which
+ * doubles as it fills, so that each read can ask for everything the pipe
+ * holds; the pipe itself is enlarged where the system allows.  the words
+ * are then cut from the buffer in place, so any one of them keeps all of
+ * it alive; a buffer that is mostly empty is cut down to size first.
+ */
+
+enum {
+	BQMIN = 64 * 1024,	/* the first buffer */
+	BQPIPESIZE = 1 << 20	/* what to ask for the pipe */
+};
 
 static List *bqinput(const char *sep, int fd) {
 	long n;
-	char in[BUFSIZE];
-	startsplit(sep, true);
+	size_t size = BQMIN, len = 0;
+	char *buf = reinterpret_cast<char *>(galloc_atomic(size));
 
 restart:
-	while ((n = eread(fd, in, sizeof in)) > 0)
-		splitstring(in, n, false);
+	for (;;) {
+		if (size - len < size / 4) {
+			char *bigger = reinterpret_cast<char *>(galloc_atomic(size * 2));
+			memcpy(bigger, buf, len);
+			buf = bigger;
+			size *= 2;
+		}
+		/* leave a byte for the NUL that ends the last word */
+		if ((n = eread(fd, buf + len, size - len - 1)) <= 0)
+			break;
+		len += n;
+	}
 	SIGCHK();
 	if (n == -1) {
 		if (errno == EINTR)
@@ -377,7 +396,9 @@ restart:
 		close(fd);
 		fail("$&backquote", "read: %s", xsstrerror(errno));
 	}
-	return endsplit();
+	if (len + 1 <= size / 2)
+		buf = reinterpret_cast<char *>(GC_REALLOC(buf, len + 1));
+	return splitbuffer(buf, len, sep);
 }
 
 PRIM(backquote) {
@@ -406,12 +427,15 @@ PRIM(backquote) {
 	}
 
 	close(p[1]);
-	
+#ifdef F_SETPIPE_SZ
+	fcntl(p[0], F_SETPIPE_SZ, BQPIPESIZE);	/* a bigger pipe is only an aid */
+#endif
+
 	list = bqinput(sep, p[0]);
 	close(p[0]);
 	status = ewaitfor(pid);
 	printstatus(0, status);
-	list = mklist(mkstr(mkstatus(status)), list);
+	list = mkstrcell(mkstatus(status), list);
 	
 	SIGCHK();
 	return list;
@@ -422,54 +446,118 @@ PRIM(newfd) {
 	(void)evalflags;
 	if (list != NULL)
 		fail("$&newfd", "usage: $&newfd");
-	return mklist(mkstr(str("%d", newfd())), NULL);
-}
-
-/* read1 -- read one byte */
-static int read1(int fd) {
-	int nread;
-	unsigned char buf;
-	do {
-		nread = eread(fd, (char *) &buf, 1);
-		SIGCHK();
-	} while (nread == -1 && errno == EINTR);
-	if (nread == -1)
-		fail("$&read/$&getc", xsstrerror(errno));
-	return nread == 0 ? EOF : buf;
+	return mkstrcell(str("%d", newfd()), NULL);
 }
 
 PRIM(read) {
-	(void)list;
 	(void)binding;
 	(void)evalflags;
-	int c;
-	int fd = fdmap(0);
+	int c, delim = '\n';
+	long count = 1;
+	bool many = false;
+	const char * const usage = "read [-d delimiter] [-n count]";
+
+	xsoptbegin(list, "$&read", usage);
+	while ((c = xsopt("d:n:")) != EOF)
+		switch (c) {
+		case 'd':
+			delim = (unsigned char) *getstr(xsoptarg());
+			break;
+		case 'n': {
+			char *end;
+			const char *s = getstr(xsoptarg());
+			count = strtol(s, &end, 10);
+			if (*s == '\0' || *end != '\0' || count < 0) {
+				xsoptend();
+				fail("$&read", "usage: %s", usage);
+			}
+			many = true;
+			break;
+		}
+		}
+	if (xsoptend() != NULL)
+		fail("$&read", "usage: %s", usage);
 
-	stringstream buffer;
+	int fd = fdmap(0);
+	std::string line;
+	if (!many) {
+		c = readuntil(fd, delim, line);
+		return c == EOF && line.empty()
+			? NULL
+			: mkstrcell(gcndup(line.data(), line.size()), NULL);
+	}
 
-	while ((c = read1(fd)) != EOF && c != '\n')
-		buffer.put(c);
+	std::vector< Term *, gc_allocator<Term *> > lines;
+	for (; count > 0; count--) {
+		line.clear();
+		c = readuntil(fd, delim, line);
+		if (c == EOF && line.empty())
+			break;
+		lines.push_back(mkstr(gcndup(line.data(), line.size())));
+		if (c == EOF)
+			break;
+	}
+	return mklists(lines.data(), lines.size(), NULL);
+}
 
-	return c == EOF && buffer.str() == ""
-		? NULL
-		: mklist(mkstr(gcdup(buffer.str().c_str())), NULL);
+/* lines -- run a body on each line read from fd, or on count lines at once */
+PRIM(lines) {
+	(void)binding;
+	int c;
+	const char *n = "1";
+	const char * const usage = "lines [-n count] fd body";
+
+	caller = "$&lines";
+	xsoptbegin(list, caller, usage);
+	while ((c = xsopt("n:")) != EOF)
+		n = getstr(xsoptarg());
+	list = xsoptend();
+	long count = getnumber(n);
+	if (length(list) != 2 || count == 0)
+		fail(caller, "usage: %s", usage);
+	int fd = fdmap(getnumber(getstr(list->term)));
+	Term *body = list->next->term;
+
+	std::vector< Term *, gc_allocator<Term *> > lines;
+	std::string line;
+	const List *result = ltrue;
+	try {
+		for (c = 0; c != EOF;) {
+			lines.clear();
+			while ((long) lines.size() < count) {
+				line.clear();
+				if ((c = readuntil(fd, '\n', line)) == EOF
+				    && line.empty())
+					break;
+				lines.push_back(mkstr(gcndup(line.data(),
+							     line.size())));
+				if (c == EOF)
+					break;
+			}
+			if (lines.empty())
+				break;
+			result = eval(mklist(body, mklists(lines.data(),
+							   lines.size(), NULL)),
+				      NULL, evalflags & eval_exitonfalse);
+			SIGCHK();
+		}
+	} catch (List *e) {
+		if (!termeq(e->term, "break"))
+			throw e;
+		return e->next;
+	}
+	return result;
 }
 
 PRIM(getc) {
 	(void)list;
 	(void)binding;
 	(void)evalflags;
-	int c;
-	int fd = fdmap(0);
-
-	stringstream buffer;
-
-	c = read1(fd);
-	if (c != EOF) buffer.put(c);
-
-	return c == EOF || buffer.str() == ""
-		? NULL
-		: mklist(mkstr(gcdup(buffer.str().c_str())), NULL);
+	int c = readbyte(fdmap(0));
+	if (c == EOF)
+		return NULL;
+	char ch = c;
+	return mkstrcell(gcndup(&ch, 1), NULL);
 }
 
 PRIM(tctl) {
@@ -509,6 +597,7 @@ extern void initprims_io(Prim_dict& primdict) {
 	X(readfrom);
 	X(writeto);
 	X(read);
+	X(lines);
 	X(getc);
 	X(tctl);
 }
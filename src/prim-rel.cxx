@@ -2,34 +2,35 @@
 
 #include "xs.hxx"
 #include "prim.hxx"
+#include "term.hxx"
 #include <string.h>
-#include <stdlib.h>
 
-static int isnumber(const char *s) {
-	return strspn(s, "-0123456789.") == strlen(s);
-}
-
-static int isfloat(const char *s) {
-	return strchr(s, '.') != NULL;
+static double floatval(Term *term) {
+	return term->numtype == num_float ? term->num.d : term->num.i;
 }
 
+/* cmp -- numbers by value, as int64 unless either is a float; else text */
 PRIM(cmp) {
 	(void)binding;
 	(void)evalflags;
-	const char *a = list == NULL ? "" : getstr(list->term);
-	const char *b = (list == NULL || list->next == NULL)
-				? "" : getstr(list->next->term);
+	Term *ta = list == NULL ? NULL : list->term;
+	Term *tb = (list == NULL || list->next == NULL) ? NULL : list->next->term;
 	long r;
-	if (isnumber(a) && isnumber(b)) {
-		if (isfloat(a) || isfloat(b)) {
-			float va = strtod(a, NULL);
-			float vb = strtod(b, NULL);
+	if (ta != NULL && tb != NULL
+	    && numval(ta) != num_bad && numval(tb) != num_bad) {
+		if (ta->numtype == num_int && tb->numtype == num_int)
+			r = ta->num.i > tb->num.i ? 1 : ta->num.i < tb->num.i ? -1 : 0;
+		else {
+			double va = floatval(ta), vb = floatval(tb);
 			r = va > vb ? 1 : va < vb ? -1 : 0;
-		} else r = strtol(a, NULL, 10) - strtol(b, NULL, 10);
-	} else r = strcoll(a, b);
+		}
+		return mkintcell(r, NULL);
+	}
 
-	list = mklist(mkstr(str("%d", r > 0 ? 1 : r < 0 ? -1 : 0)), NULL);
-	return list;
+	const char *a = ta == NULL ? "" : getstr(ta);
+	const char *b = tb == NULL ? "" : getstr(tb);
+	r = strcoll(a, b);
+	return mkintcell(r > 0 ? 1 : r < 0 ? -1 : 0, NULL);
 }
 
 extern void initprims_rel(Prim_dict& primdict) {
@@ -45,7 +45,7 @@ PRIM(background) {
 		mvfd(eopen("/dev/null", oOpen), 0);
 		exit(exitstatus(eval(list, NULL, evalflags | eval_inchild)));
 	}
-	return mklist(mkstr(str("%d", pid)), NULL);
+	return mkstrcell(str("%d", pid), NULL);
 }
 
 PRIM(fork) {
@@ -54,18 +54,18 @@ PRIM(fork) {
 	pid = efork(true, false);
 	if (pid == 0) {
 		int cpid = getpid();
-		vardef("pid", NULL, mklist(mkstr(str("%d", cpid)), NULL));
+		vardef("pid", NULL, mkstrcell(str("%d", cpid), NULL));
 		vardef("signals", NULL, NULL);
 		List* shlvl = varlookup("SHLVL", NULL);
 		const char *lvl = getstr(shlvl->term);
-		shlvl = mklist(mkstr(str("%d", atoi(lvl)+1)), NULL);
+		shlvl = mkstrcell(str("%d", atoi(lvl)+1), NULL);
 		vardef("SHLVL", NULL, shlvl);
 		exit(exitstatus(eval(list, NULL, evalflags | eval_inchild)));
 	}
 	status = ewaitfor(pid);
 	SIGCHK();
 	printstatus(0, status);
-	return mklist(mkstr(mkstatus(status)), NULL);
+	return mkstrcell(mkstatus(status), NULL);
 }
 
 PRIM(run) {
@@ -337,7 +337,7 @@ PRIM(time) {
 		list, " "
 	);
 
-	return mklist(mkstr(mkstatus(status)), NULL);
+	return mkstrcell(mkstatus(status), NULL);
 }
 
 PRIM(sleep) {
@@ -34,6 +34,7 @@ extern void initprims(void) {
 	initprims_sys(prims);
 	initprims_proc(prims);
 	initprims_access(prims);
+	initprims_compile(prims);
 
 #define	primdict prims
 	X(primitives);
@@ -19,4 +19,5 @@ extern void initprims_sys(Prim_dict& primdict);		/* prim-sys.cxx */
 extern void initprims_rel(Prim_dict& primdict);		/* prim-rel.cxx */
 extern void initprims_proc(Prim_dict& primdict);	/* proc.cxx */
 extern void initprims_access(Prim_dict& primdict);	/* access.cxx */
+extern void initprims_compile(Prim_dict& primdict);	/* compile.cxx */
 
@@ -5,6 +5,7 @@
 #include <list>
 using std::list;
 #include <sys/resource.h>
+#include <sys/syscall.h>
 
 bool hasforked = false;
 
@@ -28,6 +29,7 @@ extern Proc *mkproc(int pid, bool background) {
 
 /* efork -- fork (if necessary) and clean up as appropriate */
 extern int efork(bool parent, bool background) {
+	givebackall();
 	if (parent) {
 		int pid = fork();
 		switch (pid) {
@@ -47,24 +49,90 @@ extern int efork(bool parent, bool background) {
 	return 0;
 }
 
+/* espawn -- start a program in a new process without forking the shell;
+   returns -1 if that didn't work, so the caller can fork and say why */
+extern int espawn(const char *file, char **argv, char **envp) {
+#if USE_SPAWN
+	givebackall();
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	sigset_t defaults;
+	pid_t pid;
+
+	posix_spawn_file_actions_init(&actions);
+	if (!spawnfds(&actions)) {
+		posix_spawn_file_actions_destroy(&actions);
+		return -1;
+	}
+	posix_spawnattr_init(&attr);
+	getsigdefaults(&defaults);
+	posix_spawnattr_setsigdefault(&attr, &defaults);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+	int error = posix_spawn(&pid, file, &actions, &attr, argv, envp);
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+	if (error != 0)
+		return -1;
+	mkproc(pid, false);
+	return pid;
+#else
+	(void)file;
+	(void)argv;
+	(void)envp;
+	return -1;
+#endif
+}
+
 static struct rusage wait_rusage;
 
-/* dowait -- a wait wrapper that interfaces with signals */
-static int dowait(int *statusp) {
-	int n;
-	interrupted = false;
-	if (!xs_setjmp(slowlabel)) {
-		slow = true;
-		n = interrupted ? -2 :
-			wait3((int *) statusp, 0, &wait_rusage);
+/* pidfd -- a descriptor that polls readable once pid has exited, or -1 */
+static int pidfd(int pid) {
+#ifdef SYS_pidfd_open
+	return syscall(SYS_pidfd_open, pid, 0);
+#else
+	(void)pid;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/*
+ * dowait -- a wait wrapper that interfaces with signals; pid is the process
+ *	awaited, or 0 for any.  an interruptible wait is done in poll(), on
+ *	descriptors for the processes, so that a signal ends it like any
+ *	slow system call; where there are no such descriptors, a signal that
+ *	comes just before wait3() is only seen once some child exits.
+ */
+static int dowait(int pid, bool interruptible, int *statusp) {
+	if (!interruptible)
+		return wait3(statusp, 0, &wait_rusage);
+	static std::vector<struct pollfd> fds;
+	fds.clear();
+	bool canpoll = true;
+	foreach (Proc &proc, proclist)
+		if (proc.alive && (pid == 0 || proc.pid == pid)) {
+			struct pollfd fd;
+			fd.fd = pidfd(proc.pid);
+			fd.events = POLLIN;
+			if (fd.fd == -1)
+				canpoll = false;
+			else
+				fds.push_back(fd);
+		}
+	bool ready = true;
+	if (canpoll && !fds.empty()) {
+		fds.resize(fds.size() + 1);
+		ready = waitfds(fds.data(), fds.size() - 1);
+		fds.pop_back();
 	} else
-		n = -2;
-	slow = false;
-	if (n == -2) {
+		interrupted = false;
+	foreach (struct pollfd &fd, fds)
+		close(fd.fd);
+	if (!ready || interrupted) {
 		errno = EINTR;
-		n = -1;
+		return -1;
 	}
-	return n;
+	return wait3(statusp, 0, &wait_rusage);
 }
 
 /* reap -- mark a process as dead and attach its exit status */
@@ -88,7 +156,8 @@ top:
 			int status;
 			if (proc->alive) {
 				int deadpid;
-				while ((deadpid = dowait(&proc->status)) != pid)
+				while ((deadpid = dowait(pid, interruptible,
+							 &proc->status)) != pid)
 					if (deadpid != -1)
 						reap(deadpid, proc->status);
 					else if (errno != EINTR) {
@@ -111,7 +180,7 @@ top:
 		}
 	if (pid == 0) {
 		int status;
-		while ((pid = dowait(&status)) == -1) {
+		while ((pid = dowait(0, interruptible, &status)) == -1) {
 			if (errno != EINTR) {
 				fail("xs:ewait", "wait: %s", xsstrerror(errno));
 			}
@@ -154,7 +223,7 @@ PRIM(wait) {
 		fail("$&wait", "usage: $&wait [pid]");
 		NOTREACHED;
 	}
-	return mklist(mkstr(mkstatus(ewait(pid, true, NULL))), NULL);
+	return mkstrcell(mkstatus(ewait(pid, true, NULL)), NULL);
 }
 
 extern void initprims_proc(Prim_dict& primdict) {
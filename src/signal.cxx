@@ -2,14 +2,14 @@
 
 #include "xs.hxx"
 #include "sigmsgs.hxx"
+#include <fcntl.h>
 
 typedef Sigresult (*Sighandler)(int);
 
 bool sigint_newline = true;
 
-xs_jmp_buf slowlabel;
-Atomic slow = false;
 Atomic interrupted = false;
+static int sigpipe[2] = { -1, -1 };
 static Atomic sigcount;
 static Atomic caught[NSIG];
 static Sigeffect sigeffect[NSIG];
@@ -80,12 +80,67 @@ static void catcher(int sig) {
 			++sigcount;
 		}
 		interrupted = true;
-		if (slow)
-			xs_longjmp(slowlabel, 1);
+		if (sigpipe[1] != -1) {
+			int saved = errno;
+			(void) write(sigpipe[1], "", 1);
+			errno = saved;
+		}
 	}
 }
 
 
+/*
+ * waiting
+ *	besides noting a signal, catcher() writes a byte to a pipe, which
+ *	is polled along with whatever a slow system call is waiting for.
+ *	a signal that comes after interrupted is cleared, but before poll()
+ *	has begun, still ends the wait, so the system call that follows
+ *	never blocks where a signal could be missed.
+ */
+
+/* drainsigs -- empty the signal pipe */
+static void drainsigs(void) {
+	char buf[64];
+	while (read(sigpipe[0], buf, sizeof buf) > 0)
+		;
+}
+
+/* waitfds -- wait until one of fds[0..n-1] is ready, or a signal comes;
+   fds must have room for one more.  false, with errno EINTR, on a signal */
+extern bool waitfds(struct pollfd *fds, int n) {
+	interrupted = false;
+	if (sigpipe[0] == -1)
+		return true;
+	fds[n].fd = sigpipe[0];
+	fds[n].events = POLLIN;
+	for (;;) {
+		if (poll(fds, n + 1, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			return true;	/* let the system call report it */
+		}
+		if (fds[n].revents != 0) {
+			drainsigs();	/* maybe left over from an earlier signal */
+			if (interrupted) {
+				errno = EINTR;
+				return false;
+			}
+		}
+		for (int i = 0; i < n; i++)
+			if (fds[i].revents != 0)
+				return true;
+	}
+}
+
+/* waitfd -- wait until fd is ready for events, or a signal comes */
+extern bool waitfd(int fd, short events) {
+	struct pollfd fds[2];
+	fds[0].fd = fd;
+	fds[0].events = events;
+	return waitfds(fds, 1);
+}
+
+
 /*
  * setting and getting signal effects
  */
@@ -189,6 +244,17 @@ extern void initsignals(bool interactive, bool allowdumps) {
 			esignal(SIGQUIT, sig_noop);
 	}
 
+	if (pipe(sigpipe) == 0) {
+		for (int i = 0; i < 2; i++) {
+			fcntl(sigpipe[i], F_SETFL, O_NONBLOCK);
+			fcntl(sigpipe[i], F_SETFD, FD_CLOEXEC);
+			/* a forked child closes these in setsigdefaults(),
+			   and exec closes them for a spawned one */
+			registerfd(&sigpipe[i], false);
+		}
+	} else
+		sigpipe[0] = sigpipe[1] = -1;
+
 	/* here's the end-run around set-signals */
 	Dyvar settor("set-signals", NULL);
 	vardef("signals", NULL, mksiglist());
@@ -196,6 +262,11 @@ extern void initsignals(bool interactive, bool allowdumps) {
 
 extern void setsigdefaults(void) {
 	int sig;
+	for (int i = 0; i < 2; i++)
+		if (sigpipe[i] != -1) {
+			close(sigpipe[i]);
+			sigpipe[i] = -1;
+		}
 	for (sig = 1; sig < NSIG; sig++) {
 		Sigeffect e = sigeffect[sig];
 		if (e == sig_catch || e == sig_noop || e == sig_special)
@@ -203,6 +274,16 @@ extern void setsigdefaults(void) {
 	}
 }
 
+/* getsigdefaults -- the signals setsigdefaults() would reset */
+extern void getsigdefaults(sigset_t *set) {
+	sigemptyset(set);
+	for (int sig = 1; sig < NSIG; sig++) {
+		Sigeffect e = sigeffect[sig];
+		if (e == sig_catch || e == sig_noop || e == sig_special)
+			sigaddset(set, sig);
+	}
+}
+
 
 /*
  * utility functions
@@ -281,7 +362,7 @@ extern void sigchk(void) {
 	}
 	resetparser();
 	List* e =
-	    mklist(mkstr("signal"), mklist(mkstr(signame(sig)), NULL));
+	    mkstrcell("signal", mkstrcell(signame(sig), NULL));
 
 	switch (sigeffect[sig]) {
 	case sig_catch:
@@ -1,20 +1,33 @@
 /* split.cxx -- split strings based on separators */
 
 #include "xs.hxx"
-#include <sstream>
-using std::stringstream;
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * a word is cut straight out of the input when it ends in the same piece
+ * of input it began in; only a word that runs on into the next call of
+ * splitstring() is gathered in partial.  separators are found 16 bytes at
+ * a time where the machine allows, comparing against each separator (and
+ * NUL, which always separates), or by table when there are many of them.
+ */
 
 static bool coalesce;
 static bool splitchars;
-static stringstream buf;
-static List *value;
+static std::string partial;
+static std::vector< Term *, gc_allocator<Term *> > value;
 
 static bool ifsvalid = false;
 static char ifs[10], isifs[256];
 
+enum { MAXVECSEPS = 4 };	/* more separators than this are found by table */
+static unsigned char seps[MAXVECSEPS];
+static int nseps;		/* the separators, NUL included, or 0 for the table */
+
 extern void startsplit(const char *sep, bool coalescef) {
-	value = NULL;
-	buf.str("");
+	value.clear();
+	partial.clear();
 	coalesce = coalescef;
 	splitchars = !coalesce && *sep == '\0';
 
@@ -25,81 +38,119 @@ extern void startsplit(const char *sep, bool coalescef) {
 		} else ifsvalid = false;
 
 		memzero(isifs, sizeof isifs);
-
+		nseps = 0;
 		isifs[(unsigned char)'\0'] = true;
+		seps[nseps++] = '\0';
 		for (int c; (c = (*(unsigned const char *)sep)) != '\0'; sep++)
-			isifs[c] = true;
+			if (!isifs[c]) {
+				isifs[c] = true;
+				if (nseps > 0 && nseps < MAXVECSEPS)
+					seps[nseps++] = c;
+				else
+					nseps = 0;
+			}
 	}
 }
 
-static void skipifs(unsigned char*& s, unsigned char * inend) {
-	assert(coalesce);
-	while (s < inend) {
-		int c = *s++;
-		if (!isifs[c]) {
-			buf.put(c);
-			return;
+/* findsep -- the first separator in [s, end), or end */
+static const unsigned char *findsep(const unsigned char *s,
+				    const unsigned char *end) {
+#ifdef __SSE2__
+	if (nseps > 0) {
+		__m128i want[MAXVECSEPS];
+		for (int i = 0; i < nseps; i++)
+			want[i] = _mm_set1_epi8(seps[i]);
+		for (; end - s >= 16; s += 16) {
+			__m128i chunk = _mm_loadu_si128(
+				reinterpret_cast<const __m128i *>(s));
+			__m128i hit = _mm_cmpeq_epi8(chunk, want[0]);
+			for (int i = 1; i < nseps; i++)
+				hit = _mm_or_si128(hit,
+						   _mm_cmpeq_epi8(chunk, want[i]));
+			int mask = _mm_movemask_epi8(hit);
+			if (mask != 0)
+				return s + __builtin_ctz(mask);
 		}
 	}
-	buf.str(""); /* Tell endsplit not to touch buf */
-}
-
-template <bool coalesce>
-static inline void newbuf(unsigned char*& s, unsigned char *inend) {
-	buf.str("");
-	if (coalesce) skipifs(s, inend);
+#endif
+	while (s < end && !isifs[*s])
+		s++;
+	return s;
 }
 
-template <bool coalesce>
-static inline void handleifs(unsigned char*& s, unsigned char *inend) {
-	Term *term = mkstr(gcdup(buf.str().c_str()));
-	value = mklist(term, value);
-	newbuf<coalesce>(s, inend);
-}
-
-/* Doesn't handle splitchars case, only coalesce + normal */
-template <bool coalesce>
-static void runsplit(unsigned char*& s, unsigned char * inend) {
-	if (coalesce) skipifs(s, inend);
-	while (s < inend) {
-		int c = *s++;
-		if (isifs[c]) handleifs<coalesce>(s, inend);
-		else buf.put(c);
+/* addword -- add the word ending at [s, end), after any partial start */
+static inline void addword(const unsigned char *s, const unsigned char *end) {
+	const char *p = reinterpret_cast<const char *>(s);
+	if (partial.empty()) {
+		if (end > s || !coalesce)
+			value.push_back(mkstr(gcndup(p, end - s)));
+		return;
 	}
+	partial.append(p, end - s);
+	value.push_back(mkstr(gcndup(partial.data(), partial.size())));
+	partial.clear();
 }
 
 extern void splitstring(const char *in, size_t len, bool endword) {
-	unsigned char *s = (unsigned char *) in, *const inend = s + len;
+	const unsigned char *s = reinterpret_cast<const unsigned char *>(in);
+	const unsigned char *const inend = s + len;
 
 	if (splitchars) {
-		while (s < inend) {
-			Term *term = mkstr(gcndup((char *) s++, 1));
-			value = mklist(term, value);
-		}
-		
+		for (; s < inend; s++)
+			value.push_back(mkstr(gcndup(reinterpret_cast<const char *>(s), 1)));
 		return;
-	} 
-	else if (coalesce) runsplit<true>(s, inend);
-	else runsplit<false>(s, inend);
-
-	if (endword && buf.tellp() > 0) {
-		Term *term = mkstr(gcdup(buf.str().c_str()));
-		value = mklist(term, value);
-		buf.str("");
+	}
+
+	for (;;) {
+		const unsigned char *sep = findsep(s, inend);
+		if (sep == inend) {
+			if (endword) {
+				if (s < inend || !partial.empty())
+					addword(s, inend);
+			} else
+				partial.append(reinterpret_cast<const char *>(s),
+					       inend - s);
+			return;
+		}
+		addword(s, sep);
+		s = sep + 1;
 	}
 }
 
 extern List* endsplit(void) {
-	if (buf.tellp() > 0) {
-		Term* term = mkstr(gcdup(buf.str().c_str()));
-		value = mklist(term, value);
-		buf.str("");
+	if (!partial.empty()) {
+		value.push_back(mkstr(gcndup(partial.data(), partial.size())));
+		partial.clear();
 	}
-	List* result = reverse(value);
-	value = NULL;
+	List* result = mklists(value.data(), value.size(), NULL);
+	value.clear();
 	return result;
 }
 
+/*
+ * splitbuffer -- split all of a buffer at once, as for a backquote; the
+ *	words are cut in place, with NULs written over the separators, so
+ *	buf needs a byte to spare after len, and stays as long as any word
+ */
+extern List *splitbuffer(char *buf, size_t len, const char *sep) {
+	buf[len] = '\0';
+	if (*sep == '\0' && memchr(buf, '\0', len) == NULL)
+		return (len == 0) ? NULL : mkstrcell(buf, NULL);
+
+	startsplit(sep, true);
+	unsigned char *s = reinterpret_cast<unsigned char *>(buf);
+	unsigned char *const end = s + len;
+	while (s < end) {
+		unsigned char *sep = const_cast<unsigned char *>(findsep(s, end));
+		if (sep > s) {
+			*sep = '\0';
+			value.push_back(mkstr(reinterpret_cast<char *>(s)));
+		}
+		s = sep + 1;
+	}
+	return endsplit();
+}
+
 extern List* fsplit(const char *sep, List* list, bool coalesce) {
 	startsplit(sep, coalesce);
 	for (; list; list = list->next) {
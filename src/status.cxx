@@ -4,11 +4,11 @@
 #include "term.hxx"
 
 static const Term
-	trueterm	= { "0", NULL },
-	falseterm	= { "1", NULL };
+	trueterm	= { "0", NULL, num_int, { 0 } },
+	falseterm	= { "1", NULL, num_int, { 1 } };
 static const List
-	truelist	= { (Term *) &trueterm, NULL },
-	falselist	= { (Term *) &falseterm, NULL };
+	truelist	= { (Term *) &trueterm, NULL, 1 },
+	falselist	= { (Term *) &falseterm, NULL, 1 };
 const List
 	*ltrue		= &truelist,
 	*lfalse		= &falselist;
@@ -19,9 +19,11 @@ extern bool istrue(const List *status) {
 		Term *term = status->term;
 		if (term->closure != NULL)
 			return false;
-		else {
+		else if (term->str == NULL) {
+			if (term->numtype != num_int || term->num.i != 0)
+				return false;
+		} else {
 			const char *str = term->str;
-			assert(str != NULL);
 			if (*str != '\0' && (*str != '0' || str[1] != '\0'))
 				return false;
 		}
@@ -43,7 +45,7 @@ extern int exitstatus(const List *status) {
 	if (term->closure != NULL)
 		return 1;
 
-	s = term->str;
+	s = getstr(term);
 	if (*s == '\0')
 		return 0;
 	char *endptr;
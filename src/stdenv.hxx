@@ -23,14 +23,15 @@ using std::map;
 
 #include <string.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include <memory.h>
 
 #include <stdarg.h>
 
 #include <errno.h>
-#include <setjmp.h>
 #include <signal.h>
+#include <poll.h>
 #include <ctype.h>
 
 #if REQUIRE_STAT || REQUIRE_IOCTL
@@ -58,6 +59,10 @@ typedef struct dirent Dirent;
 
 #include <sys/wait.h>
 
+#if USE_SPAWN
+#include <spawn.h>
+#endif
+
 /* stdlib */
 
 #include <stdlib.h>
@@ -74,15 +79,6 @@ typedef struct dirent Dirent;
 #define	EOF	(-1)
 #endif
 
-/*
- * xs_setjmp/longjmp/jmp_buf ensure proper signal handling when we throw
- * out of a handler
- */
-
-# define xs_setjmp(buf) sigsetjmp(buf,1)
-# define xs_longjmp     siglongjmp
-# define xs_jmp_buf     sigjmp_buf
-
 /*
  * macros
  */
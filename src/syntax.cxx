@@ -147,7 +147,7 @@ extern Tree *mkpipe(Tree *t1, int outfd, int infd, Tree *t2) {
  *	tree and then rewriting the tree to include the appropriate commands
  */
 
-static Tree placeholder = { nRedir, {} };
+static Tree placeholder = { nRedir, true, {} };
 
 extern Tree *redirect(Tree *t) {
 	Tree *r, *p;
@@ -2,11 +2,13 @@
 
 #include "xs.hxx"
 #include "term.hxx"
+#include <stdio.h>
 
 extern Term* mkterm(const char* str, Closure* closure) {
 	Term* term = gcnew(Term);
 	term->str = str;
 	term->closure = closure;
+	term->numtype = num_none;
 	return term;
 }
 
@@ -14,21 +16,111 @@ extern Term* mkstr(const char* str) {
 	Term* term = gcnew(Term);
         term->str = str;
 	term->closure = NULL;
+	term->numtype = num_none;
         return term;
 }
 
+/*
+ * a list cell and its term are usually made together and live as long
+ * as each other, so they can share one allocation.  the term may still
+ * be shared with other lists; it keeps the cell around with it.
+ */
+
+struct Cell {
+	List list;
+	Term term;
+};
+
+static List *mkcell(List *next) {
+	Cell *cell = gcnew(Cell);
+	cell->list.term = &cell->term;
+	cell->list.next = next;
+	cell->list.run = 1;
+	return &cell->list;
+}
+
+/* mktermcell -- mklist(mkterm(str, closure), next) in one allocation */
+extern List *mktermcell(const char *str, Closure *closure, List *next) {
+	List *list = mkcell(next);
+	list->term->str = str;
+	list->term->closure = closure;
+	list->term->numtype = num_none;
+	return list;
+}
+
+/* mkstrcell -- mklist(mkstr(str), next) in one allocation */
+extern List *mkstrcell(const char *str, List *next) {
+	return mktermcell(str, NULL, next);
+}
+
+/* mkintcell -- mklist(mkint(i), next) in one allocation */
+extern List *mkintcell(int64_t i, List *next) {
+	List *list = mkcell(next);
+	list->term->str = NULL;
+	list->term->closure = NULL;
+	list->term->numtype = num_int;
+	list->term->num.i = i;
+	return list;
+}
+
+/* mkint -- a term holding an integer, formatted only when needed */
+extern Term *mkint(int64_t i) {
+	Term *term = gcnew(Term);
+	term->str = NULL;
+	term->closure = NULL;
+	term->numtype = num_int;
+	term->num.i = i;
+	return term;
+}
+
+/* mkfloat -- a term holding a floating point number */
+extern Term *mkfloat(double d) {
+	Term *term = gcnew(Term);
+	term->str = NULL;
+	term->closure = NULL;
+	term->numtype = num_float;
+	term->num.d = d;
+	return term;
+}
+
+/* numval -- the kind of number a term holds, reading its text if need be */
+extern int numval(Term *term) {
+	if (term->numtype != num_none)
+		return term->numtype;
+	if (term->closure != NULL)
+		return term->numtype = num_bad;
+	const char *s = term->str;
+	char *end = NULL;
+	errno = 0;
+	if (strchr(s, '.') == NULL) {
+		long long i = strtoll(s, &end, 10);
+		if (errno == 0 && end != s && *end == '\0') {
+			term->num.i = i;
+			return term->numtype = num_int;
+		}
+	} else {
+		double d = strtod(s, &end);
+		if (errno != EINVAL && end != s && *end == '\0') {
+			term->num.d = d;
+			return term->numtype = num_float;
+		}
+	}
+	return term->numtype = num_bad;
+}
+
 extern Closure *getclosure(Term* term) {
 	if (term->closure == NULL) {
 		const char* s = term->str;
-		assert(s);
+		if (s == NULL)	/* a number */
+			return NULL;
 		if (
 			((*s == '{' || *s == '@') && s[strlen(s) - 1] == '}')
 			|| (*s == '$' && s[1] == '&')
 			|| hasprefix(s, "%closure")
 		) {
-			Tree* np = parsestring(s);
-			if (np == NULL) return NULL;
-			term->closure = extractbindings(np);
+			Closure *closure = parseclosure(s);
+			if (closure == NULL) return NULL;
+			term->closure = closure;
 			term->str = NULL;
 		}
 	}
@@ -39,18 +131,24 @@ extern const char *getstr(Term* term) {
 	assert (term != NULL);
 	const char* s = term->str;
 	Closure* closure = term->closure;
-	assert((s == NULL) != (closure == NULL));
 	if (s != NULL)
 		return s;
-
-#if 0	/* TODO: decide whether getstr() leaves term in closure or string form */
-	s = str("%C", closure);
-	term->str = s;
-	term->closure = NULL;
-	return s;
-#else
-	return str("%C", closure);
-#endif
+	if (closure != NULL)
+		return closuretext(closure);
+	switch (term->numtype) {
+	case num_int:
+		s = str("%lld", (long long) term->num.i);
+		break;
+	case num_float: {
+		char buf[64];	/* as an ostream with showpoint would print it */
+		snprintf(buf, sizeof buf, "%#g", term->num.d);
+		s = gcdup(buf);
+		break;
+	}
+	default:
+		panic("getstr: empty term");
+	}
+	return term->str = s;
 }
 
 extern Term* termcat(Term* t1, Term* t2){
@@ -65,9 +163,9 @@ extern Term* termcat(Term* t1, Term* t2){
 
 extern bool termeq(Term *term, const char *s) {
 	assert(term != NULL);
-	if (term->str == NULL)
+	if (term->closure != NULL)
 		return false;
-	return streq(term->str, s);
+	return streq(getstr(term), s);
 }
 
 extern bool isclosure(Term *term) {
@@ -1,6 +1,20 @@
 /* term.hxx -- definition of term structure */
 
+/*
+ * a term is a string, a closure, or a number.  numbers made by arithmetic
+ * and the numeric primitives are kept unboxed, with str left NULL until
+ * something asks for their text; string terms that have been read as
+ * numbers keep the value alongside the text, so it is parsed only once.
+ */
+
+enum { num_none, num_int, num_float, num_bad };
+
 struct Term {
 	const char *str;
 	Closure *closure;
+	int numtype;
+	union {
+		int64_t i;
+		double d;
+	} num;
 };
@@ -211,6 +211,19 @@ static int yylex_arithmetic() {
 		/* FALLTHROUGH */
 	case '+': case '-': case '/': case '%':
 		return c;
+	case '<': case '>': {
+		bool less = (c == '<');
+		if ((c = GETC()) == '=')
+			return less ? LE : GE;
+		UNGETC(c);
+		return less ? LT : GT;
+	}
+	case '=': case '!': {
+		bool equal = (c == '=');
+		if ((c = GETC()) != '=')
+			goto error;
+		return equal ? EQ : NE;
+	}
 	case '*':
 		if ((c = GETC()) == '*')
 			return POW;
@@ -227,6 +240,11 @@ static int yylex_arithmetic() {
 		return c;
 	case '$': {
 		size_t i = 0;
+		bool count = false;
+		if ((c = GETC()) == '#')
+			count = true;
+		else
+			UNGETC(c);
 		while (c = GETC(), c != EOF && !adnw[c])
 			bufput(i++, c);
 		UNGETC(c);
@@ -238,7 +256,7 @@ static int yylex_arithmetic() {
 
 		bufput(i, '\0');
 		yylval.str = gcdup(buf);
-		return ARITH_VAR;
+		return count ? ARITH_COUNT : ARITH_VAR;
 	}
 	default: 
 error:
@@ -7,6 +7,42 @@ static Tree* newtree() {
 	return reinterpret_cast<Tree*>(galloc(offsetof(Tree, u[size])));
 }
 
+/* globword -- could an unquoted word glob, or expand ~ if it begins one? */
+static bool globword(const char *s) {
+	return strpbrk(s, "*?[~") != NULL;
+}
+
+/* globs -- could the words of a tree need globbing? */
+static bool globs(Tree *t) {
+	return t != NULL && t->glob;
+}
+
+/*
+ * a tree's glob flag is false if none of the words it makes can contain an
+ * unquoted wildcard or begin with an unquoted ~, so the compiler can leave
+ * them out of globbing.  values of variables, calls, and closures are
+ * always quoted; nodes that aren't words at all are assumed to glob.
+ */
+
+static void setglob(Tree *n) {
+	switch (n->kind) {
+	    case nWord:
+		n->glob = globword(n->u[0].s);
+		break;
+	    case nQword: case nPrim: case nInt: case nFloat:
+	    case nCall: case nThunk: case nLambda: case nVar: case nVarsub:
+	    case nArith: case nPipe:
+		n->glob = false;
+		break;
+	    case nList: case nConcat:
+		n->glob = globs(n->u[0].p) || globs(n->u[1].p);
+		break;
+	    default:
+		n->glob = true;
+		break;
+	}
+}
+
 /* mk -- make a new node; used to generate the parse tree */
 extern Tree *mk (int t, ...) {
 	/* t is NodeKind, which is incompatible with va_start because the
@@ -26,6 +62,7 @@ extern Tree *mk (int t, ...) {
 		n->u[0].s = va_arg(ap, char *);
 		break;
 	    case nCall: case nThunk: case nVar: case nArith:
+	    case nNegate: case nCount:
 		n = newtree<1>();
 		n->u[0].p = va_arg(ap, Tree *);
 		break;
@@ -34,6 +71,8 @@ extern Tree *mk (int t, ...) {
 	    case nVarsub: case nMatch: case nExtract:
 	    case nRedir: case nMinus: case nPlus:
 	    case nMult: case nDivide: case nModulus: case nPow:
+	    case nLess: case nLessEqual: case nGreater: case nGreaterEqual:
+	    case nEqual: case nNotEqual:
 		n = newtree<2>();
 		n->u[0].p = va_arg(ap, Tree *);
 		n->u[1].p = va_arg(ap, Tree *);
@@ -46,6 +85,28 @@ extern Tree *mk (int t, ...) {
  	}
 	n->kind = (NodeKind)t;
 	va_end(ap);
-	
+
+	setglob(n);
 	return n;
 }
+
+/* globscan -- set the glob flags of a tree the parser has rearranged */
+extern Tree *globscan(Tree *tree) {
+	if (tree == NULL)
+		return NULL;
+	switch (tree->kind) {
+	    case nWord: case nQword: case nPrim:
+	    case nInt: case nFloat: case nPipe:
+		break;
+	    case nCall: case nThunk: case nVar: case nArith:
+	    case nNegate: case nCount:
+		globscan(tree->u[0].p);
+		break;
+	    default:
+		globscan(tree->u[0].p);
+		globscan(tree->u[1].p);
+		break;
+	}
+	setglob(tree);
+	return tree;
+}
@@ -1,5 +1,7 @@
 /* util.cxx -- the kitchen sink */
 
+#define	REQUIRE_IOCTL	1
+
 #include "xs.hxx"
 #include <stdlib.h>
 #include <fcntl.h>
@@ -76,46 +78,51 @@ extern void *erealloc(void *p, size_t n) {
  * private interfaces to system calls
  */
 
-extern void ewrite(int fd, const char *buf, size_t n) {
-	volatile long i, remain;
-	const char *volatile bufp = buf;
-	for (i = 0, remain = n; remain > 0; bufp += i, remain -= i) {
-		interrupted = false;
-		if (!xs_setjmp(slowlabel)) {
-			slow = true;
-			if (interrupted)
-				break;
-			else if ((i = write(fd, bufp, remain)) <= 0)
-				break; /* abort silently on errors in write() */
-		} else
-			break;
-		slow = false;
-	}
-	slow = false;
-	SIGCHK();
+/*
+ * slow system calls wait in poll(), which a signal ends (see waitfd());
+ * for reads, the number of bytes found waiting after poll() is kept, so
+ * that a loop reading a pipe a little at a time polls only when it has
+ * to.  the count is forgotten whenever fd might become another file.
+ */
+
+static int readyfd = -1;
+static long readycount = 0;
+
+/* forgetready -- fd is changing, so what was waiting on it no longer is */
+extern void forgetready(int fd) {
+	if (fd == readyfd)
+		readyfd = -1;
 }
 
-/* qstrcmp -- a strcmp wrapper for sort */
-extern int qstrcmp(const char *s1, const char *s2) {
-	return strcmp(s1, s2) < 0;
+extern void ewrite(int fd, const char *buf, size_t n) {
+	long i, remain;
+	const char *bufp = buf;
+	for (i = 0, remain = n; remain > 0; bufp += i, remain -= i)
+		if (!waitfd(fd, POLLOUT)
+		    || (i = write(fd, bufp, remain)) <= 0)
+			break; /* abort silently on errors in write() */
+	SIGCHK();
 }
 
 extern long eread(int fd, char *buf, size_t n) {
 	long r;
-	interrupted = false;
-	if (!xs_setjmp(slowlabel)) {
-		slow = true;
-		if (!interrupted)
-			r = read(fd, buf, n);
-		else
-			r = -2;
-	} else
-		r = -2;
-	slow = false;
-	if (r == -2) {
-		errno = EINTR;
-		r = -1;
+	if (fd != readyfd || readycount <= 0) {
+		readyfd = -1;
+		if (!waitfd(fd, POLLIN)) {
+			SIGCHK();
+			return -1;
+		}
+		int avail;
+		if (ioctl(fd, FIONREAD, &avail) == 0 && avail > 0) {
+			readyfd = fd;
+			readycount = avail;
+		}
 	}
+	r = read(fd, buf, n);
+	if (r > 0)
+		readycount -= r;
+	else
+		readyfd = -1;
 	SIGCHK();
 	return r;
 }
@@ -143,7 +150,7 @@ extern int eopen(const char *name, OpenKind k) {
 
 // strdup
 extern char *gcndup(const char* s, size_t n) {
-	char* ns = reinterpret_cast<char*>(galloc((n + 1) * sizeof (char)));
+	char* ns = reinterpret_cast<char*>(galloc_atomic((n + 1) * sizeof (char)));
 	memcpy(ns, s, n);
 	ns[n] = '\0';
 	assert(strlen(ns) == n);
@@ -160,7 +167,16 @@ extern void fail (const char * from,  const char * fmt, ...) {
 	s = strv(fmt, args);
 	va_end(args);
 
-	throw mklist(mkstr("error"),
-		      	mklist(mkstr((char *) from),
-			     	mklist(mkstr(s), NULL)));
+	throw mkstrcell("error",
+		      	mkstrcell((char *) from,
+			     	mkstrcell(s, NULL)));
+}
+
+/* strhash -- hash a string (FNV-1a) */
+extern unsigned long strhash(const char *s) {
+	unsigned long h = 2166136261UL;
+	int c;
+	while ((c = (unsigned char) *s++) != '\0')
+		h = (h ^ c) * 16777619UL;
+	return h;
 }
@@ -5,22 +5,31 @@
 #include "term.hxx"
 #include <vector>
 #include <algorithm>
-#include <set>
 #include <string>
 using std::string;
-using std::set;
 
 #define	ENV_FORMAT	"%F=%W"
 #define	ENV_DECODE	"%N"
 
-static set<string> noexport;
+static std::vector<Symbol *> noexport;
 Dict vars;
 
-static Vector env, sortenv;
-static bool isdirty = true;
-static bool rebound = true;
+/*
+ * the environment
+ *	env holds the exported variables as name=value strings, sorted and
+ *	followed by a NULL, ready for execve(); envsyms holds their symbols
+ *	in the same order.  assignments queue the symbol on envqueue, and
+ *	mkenv() brings just those entries up to date.  rebuilding the whole
+ *	thing is left for changes to many variables at once.
+ */
 
-static bool specialvar(string name) {
+static Vector env;
+static std::vector<Symbol *> envsyms;
+static std::vector<Symbol *> envqueue;
+static bool envall = true;	/* rebuild the whole environment */
+static unsigned long envgen;	/* bindgen when env was last built */
+
+static bool specialvar(const char *name) {
 	return (name[0] == '*' || name[0] == '0') && name[1] == '\0';
 }
 
@@ -35,14 +44,26 @@ static bool hasbindings(List* list) {
 	return false;
 }
 
-static Var *mkvar(List* defn) {
+static Var *mkvar(Symbol *sym, List* defn) {
 	Var* var = gcnew(Var);
 	var->env = NULL;
+	var->gen = 0;
 	var->flags = hasbindings(defn) ? var_hasbindings : 0;
 	var->defn = defn;
+	var->sym = sym;
 	return var;
 }
 
+static bool isexported(Symbol *sym);
+
+/* envchanged -- note that a variable's entry in the environment is stale */
+static void envchanged(Symbol *sym) {
+	if (!sym->envqueued && isexported(sym)) {
+		sym->envqueued = true;
+		envqueue.push_back(sym);
+	}
+}
+
 /* iscounting -- is it a counter number, i.e., an integer > 0 */
 static bool iscounting(const char *name) {
 	int c;
@@ -56,6 +77,36 @@ static bool iscounting(const char *name) {
 }
 
 
+/* intern -- find or create the symbol for a name */
+extern Symbol *intern(const char *name) {
+	return vars.intern(name);
+}
+
+/* fnsymbol -- the symbol for the function of the same name */
+extern Symbol *fnsymbol(Symbol *sym) {
+	if (sym->fn == NULL)
+		sym->fn = intern(str("fn-%s", sym->name));
+	return sym->fn;
+}
+
+/* setsymbol -- the symbol for the settor of the same name */
+extern Symbol *setsymbol(Symbol *sym) {
+	if (sym->set == NULL)
+		sym->set = intern(str("set-%s", sym->name));
+	return sym->set;
+}
+
+/* setvar -- install a new global variable */
+static Var *setvar(Symbol *sym, Var *var) {
+	return sym->var = var;
+}
+
+/* unsetvar -- remove a global variable */
+static void unsetvar(Symbol *sym) {
+	sym->var = NULL;
+}
+
+
 /*
  * public entry points
  */
@@ -69,20 +120,22 @@ extern void validatevar(const char *var) {
 }
 
 /* isexported -- is a variable exported? */
-static bool isexported(string name) {
-	if (specialvar(name))
-		return false;
-	if (noexport.empty())
-		return true;
-	return noexport.count(name) == 0;
+static bool isexported(Symbol *sym) {
+	return !specialvar(sym->name) && !sym->noexport;
 }
 
 /* setnoexport -- mark a list of variable names not for export */
 extern void setnoexport(List *list) {
-	isdirty = true;
+	envall = true;
+	for (std::vector<Symbol *>::iterator i = noexport.begin();
+	     i != noexport.end(); ++i)
+		(*i)->noexport = false;
 	noexport.clear();
-	iterate (list)
-		noexport.insert(getstr(list->term));
+	iterate (list) {
+		Symbol *sym = intern(getstr(list->term));
+		sym->noexport = true;
+		noexport.push_back(sym);
+	}
 }
 
 /* varlookup -- lookup a variable in the current context */
@@ -97,26 +150,58 @@ extern List *varlookup(const char* name, Binding* bp) {
 		if (streq(name, bp->name))
 			return bp->defn;
 
-	return vars.count(name) == 0
-		? NULL
-		: vars[name]->defn;
+	Symbol *sym = vars.lookup(name);
+	return (sym == NULL || sym->var == NULL) ? NULL : sym->var->defn;
+}
+
+/* varlookup -- lookup a variable whose name is already interned */
+extern List *varlookup(Symbol* sym, Binding* bp) {
+	iterate (bp)
+		if (streq(sym->name, bp->name))
+			return bp->defn;
+	return sym->var == NULL ? NULL : sym->var->defn;
 }
 
+/* varlookup2 -- lookup name1 name2 without interning it: most names that
+   are tried as functions are really commands, and are never defined */
 extern List *varlookup2(const char *name1, const char *name2, Binding *bp) {
-	string name = string(name1) + name2;
-        return varlookup(name.c_str(), bp);
+	iterate (bp)
+		if (streq2(bp->name, name1, name2))
+			return bp->defn;
+
+	bool isfn = streq(name1, "fn-"), isset = streq(name1, "set-");
+	Symbol *base = (isfn || isset) ? vars.lookup(name2) : NULL;
+	Symbol *sym = (base == NULL) ? NULL : isfn ? base->fn : base->set;
+	if (sym == NULL) {
+		char buf[256];
+		size_t len1 = strlen(name1), len2 = strlen(name2);
+		char *name = (len1 + len2 < sizeof buf)
+			? buf
+			: reinterpret_cast<char *>(galloc_atomic(len1 + len2 + 1));
+		memcpy(name, name1, len1);
+		memcpy(name + len1, name2, len2 + 1);
+		if (!isfn && !isset)
+			validatevar(name);
+		sym = vars.lookup(name);
+		if (sym == NULL)
+			return NULL;
+		if (base != NULL)
+			(isfn ? base->fn : base->set) = sym;
+	}
+	return sym->var == NULL ? NULL : sym->var->defn;
 }
 
-static List *callsettor(const char* name, List* defn) {
-	List* settor;
+static List *callsettor(Symbol *sym, List* defn) {
+	Var* settor;
 
-	if (specialvar(name)
-		|| (settor = varlookup2("set-", name, NULL)) == NULL)
+	if (specialvar(sym->name)
+		|| (settor = setsymbol(sym)->var) == NULL
+		|| settor->defn == NULL)
 		return defn;
 
-	Dyvar p("0", mklist(mkstr(name), NULL));
+	Dyvar p("0", mkstrcell(sym->name, NULL));
 
-	defn = listcopy(eval(append(settor, defn), NULL, 0));
+	defn = listcopy(eval(append(settor->defn, defn), NULL, 0));
 
 	return defn;
 }
@@ -126,134 +211,208 @@ extern void vardef(const char* name, Binding* binding, List* defn) {
 	iterate (binding)
 		if (streq(name, binding->name)) {
 			binding->defn = defn;
-			rebound = true;
+			binding->gen = ++bindgen;
 			return;
 		}
 
-	defn = callsettor(name, defn);
-	if (isexported(name))
-		isdirty = true;
+	Symbol *sym = intern(name);
+	defn = callsettor(sym, defn);
 
-	if (vars.count(name) != 0) {
+	if (sym->var != NULL) {
 		if (defn != NULL) {
-			Var* var = vars[name];
+			Var* var = sym->var;
 			var->defn = defn;
 			var->env = NULL;
 			var->flags = hasbindings(defn) ? var_hasbindings : 0;
-		} else vars.erase(name);
+		} else unsetvar(sym);
 	} else if (defn != NULL) {
-		vars[name] = mkvar(defn);
+		setvar(sym, mkvar(sym, defn));
 	}
+	envchanged(sym);
 }
 
 extern Dyvar::Dyvar(const char *_name, List *vardefn) {
 	validatevar(_name);
-	name = _name;
+	sym = intern(_name);
 
-	if (isexported(name))
-		isdirty = true;
-	defn = callsettor(name, vardefn);
+	defn = callsettor(sym, vardefn);
 
-	if (vars.count(name) == 0) {
+	if (sym->var == NULL) {
 		defn	= NULL;
 		flags	= 0;
-		vars[name] = mkvar(vardefn);
+		setvar(sym, mkvar(sym, vardefn));
 	} else {
-		Var *var = vars[name];
-                assert (var != NULL);
+		Var *var = sym->var;
 		defn		= var->defn;
 		flags		= var->flags;
 		var->defn	= vardefn;
 		var->env	= NULL;
 		var->flags	= hasbindings(vardefn) ? var_hasbindings : 0;
 	}
+	envchanged(sym);
+}
+
+/* rebind -- change the value of a dynamic variable, keeping the saved one */
+extern void Dyvar::rebind(List *vardefn) {
+	callsettor(sym, vardefn);
 
+	Var *var = sym->var;
+	if (var == NULL)
+		setvar(sym, mkvar(sym, vardefn));
+	else {
+		var->defn	= vardefn;
+		var->env	= NULL;
+		var->flags	= hasbindings(vardefn) ? var_hasbindings : 0;
+	}
+	envchanged(sym);
 }
 
 extern Dyvar::~Dyvar() {
-	if (isexported(name)) isdirty = true;
-	defn = callsettor(name, defn);
+	defn = callsettor(sym, defn);
 
-	if (vars.count(name) != 0)
+	if (sym->var != NULL)
 		if (defn != NULL) {
-			Var *var = vars[name];
-                        assert (var != NULL);
+			Var *var = sym->var;
 			var->defn = defn;
 			var->flags = flags;
 			var->env = NULL;
-		} else vars.erase(name);
+		} else unsetvar(sym);
 	else if (defn != NULL) {
-		Var *var = mkvar(NULL);
+		Var *var = mkvar(sym, NULL);
 		var->defn = defn;
 		var->flags = flags;
-		vars[name] = var;
+		setvar(sym, var);
 	}
-
+	envchanged(sym);
 }
 
-static void mkenv0(Dict::value_type pair) {
-	Var *var = pair.second;
+/* envstr -- the environment entry for a variable, or NULL if it has none */
+static char *envstr(Symbol *sym) {
+	Var *var = sym->var;
 	if (
 		   var == NULL
 		|| var->defn == NULL
 		|| (var->flags & var_isinternal)
-		|| !isexported(pair.first)
+		|| !isexported(var->sym)
 	)
-		return;
-	if (var->env == NULL || (rebound && (var->flags & var_hasbindings))) {
-		char *envstr = str(ENV_FORMAT, pair.first.c_str(), var->defn);
-		var->env = envstr;
+		return NULL;
+	if (var->env == NULL
+	    || ((var->flags & var_hasbindings)
+		&& reboundsince(var->defn, var->gen))) {
+		var->gen = bindgen;
+		var->env = str(ENV_FORMAT, sym->name, var->defn);
+	}
+	return var->env;
+}
+
+static bool envlt(const std::pair<char *, Symbol *> &a,
+		  const std::pair<char *, Symbol *> &b) {
+	return strcmp(a.first, b.first) < 0;
+}
+
+/* envrebuild -- make the environment from scratch */
+static void envrebuild(void) {
+	std::vector< std::pair<char *, Symbol *> > entries;
+	foreach (Symbol *sym, vars) {
+		char *s = envstr(sym);
+		if (s != NULL)
+			entries.push_back(std::make_pair(s, sym));
+	}
+	std::sort(entries.begin(), entries.end(), envlt);
+
+	env.clear();
+	envsyms.clear();
+	for (size_t i = 0; i < entries.size(); i++) {
+		env.push_back(entries[i].first);
+		envsyms.push_back(entries[i].second);
 	}
-	env.push_back(var->env);
+	env.push_back(NULL);
 }
 
+/* envupdate -- bring one variable's entry in the environment up to date */
+static void envupdate(Symbol *sym) {
+	/* names are encoded without '=', so entries sort by "name=" alone */
+	const char *key = str("%F=", sym->name);
+	size_t keylen = strlen(key);
+	size_t lo = 0, hi = envsyms.size();
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (strcmp(env[mid], key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	bool present = lo < envsyms.size() && strncmp(env[lo], key, keylen) == 0;
+
+	char *s = envstr(sym);
+	if (s != NULL && present)
+		env[lo] = s;
+	else if (s != NULL) {
+		env.insert(env.begin() + lo, s);
+		envsyms.insert(envsyms.begin() + lo, sym);
+	} else if (present) {
+		env.erase(env.begin() + lo);
+		envsyms.erase(envsyms.begin() + lo);
+	}
+}
 
+/* mkenv -- the environment for execve(), a NULL-terminated vector */
 extern Vector* mkenv(void) {
-	if (isdirty || rebound) {
-		env.clear();
-		std::for_each(vars.begin(), vars.end(), mkenv0);
-		
-		isdirty = false;
-		rebound = false;
-		sortenv = env;
-                sortenv.sort();
+	if (envall) {
+		envall = false;
+		foreach (Symbol *sym, envqueue)
+			sym->envqueued = false;
+		envqueue.clear();
+		envrebuild();
+	} else {
+		if (envgen != bindgen)
+			foreach (Symbol *sym, envsyms)
+				if (sym->var != NULL
+				    && (sym->var->flags & var_hasbindings)
+				    && reboundsince(sym->var->defn,
+						    sym->var->gen))
+					envchanged(sym);
+		foreach (Symbol *sym, envqueue) {
+			sym->envqueued = false;
+			envupdate(sym);
+		}
+		envqueue.clear();
 	}
-	return &sortenv;
+	envgen = bindgen;
+	return &env;
 }
 
 /* listvars -- return a list of all the (dynamic) variables */
 extern List *listvars(bool internal) {
 	List* varlist = NULL;
-	if (internal) {
-		foreach (Dict::value_type x, vars)
-			if (x.second->flags & var_isinternal)
-				varlist = mklist(
-						mkstr(gcdup(x.first.c_str())),
-							varlist);
-	} else { // external only
-		foreach (Dict::value_type x, vars)
-			if ((x.second->flags & var_isinternal) == 0
-				&& !specialvar(x.first))
-				varlist = mklist(
-						mkstr(gcdup(x.first.c_str())),
-							varlist);
+	Dict::Symbols syms = vars.sorted();
+	for (Dict::Symbols::reverse_iterator i = syms.rbegin();
+	     i != syms.rend(); ++i) {
+		Symbol *sym = *i;
+		if (internal
+		    ? (sym->var->flags & var_isinternal) != 0
+		    : ((sym->var->flags & var_isinternal) == 0  // external only
+		       && !specialvar(sym->name)))
+			varlist = mkstrcell(sym->name, varlist);
 	}
-	
-	return (varlist = sortlist(varlist));
+	return varlist;
 }
 
 /* hidevariables -- mark all variables as internal */
 extern void hidevariables(void) {
-	foreach (Dict::value_type x, vars) x.second->flags |= var_isinternal;
+	foreach (Symbol *sym, vars) sym->var->flags |= var_isinternal;
+	envall = true;
 }
 
 /* importvar -- import a single environment variable */
 static void importvar(const char* name, const char* value) {
 	char sep[2] = { ENV_SEPARATOR, '\0' };
 
-	List* defn = fsplit(sep, mklist(mkstr(value + 1), NULL), false);
+	List* defn = fsplit(sep, mkstrcell(value + 1, NULL), false);
 
 	if (strchr(value, ENV_ESCAPE) != NULL) {
+		/* words are unlinked below, so give each its own cell */
+		defn = reverse(reverse(defn));
 		List* list = defn;
 		iterate (list) {
 			int offset = 0;
@@ -269,7 +428,7 @@ static void importvar(const char* name, const char* value) {
 						  = list->next->term->str;
 						char *str =
 						  reinterpret_cast<char*>(
-						  galloc(offset
+						  galloc_atomic(offset
 							    + strlen(str2)+1));
 						memcpy(str, word, offset - 1);
 						str[offset - 1]
@@ -281,7 +440,7 @@ static void importvar(const char* name, const char* value) {
 					break;
 				    case ENV_ESCAPE: {
 				    	char *str = reinterpret_cast<char*>(
-						galloc(strlen(word)));
+						galloc_atomic(strlen(word)));
 					memcpy(str, word, offset);
 					strcpy(str + offset, escape + 2);
 					list->term->str = str;
@@ -301,10 +460,8 @@ extern void initenv(char **envp, bool isprotected) {
 	for (std::string envstr; *envp != NULL ; envp++) {
 		envstr = *envp;
 		size_t eq_index = envstr.find('=');
-		if (eq_index == (unsigned long)-1) {
-			env.push_back(*envp);
+		if (eq_index == (unsigned long)-1)
 			continue;
-		}
 		string name_raw = envstr.substr(0,eq_index);
 		string eq = envstr.substr(eq_index);
 		char *name = str(ENV_DECODE, name_raw.c_str());
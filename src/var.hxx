@@ -4,9 +4,29 @@ typedef struct Var Var;
 struct Var {
 	List *defn;
 	char *env;
+	unsigned long gen;	/* bindgen when env was printed */
 	int flags;
+	Symbol *sym;
 };
 
+/*
+ * every name used for a global variable is interned once as a Symbol,
+ * which points straight at the variable (if it is set) and at the
+ * symbols of the function and settor of the same name.
+ */
+
+struct Symbol {
+	const char *name;
+	Var *var;		/* the global variable, or NULL if unset */
+	Symbol *fn;		/* fn-name, filled in by fnsymbol() */
+	Symbol *set;		/* set-name, filled in by setsymbol() */
+	bool noexport;		/* named in $noexport */
+	bool envqueued;		/* waiting for mkenv() to update env */
+};
+
+extern Symbol *fnsymbol(Symbol *sym);
+extern Symbol *setsymbol(Symbol *sym);
+
 #define	var_hasbindings		1
 #define	var_isinternal		2
 
@@ -22,22 +22,36 @@
 
 struct Term;
 
+/*
+ * lists are linked cells, but cells allocated together are laid out in
+ * order, and run counts the cells from this one to the end of such a
+ * block.  length() and nth() step over whole runs.  the next pointer
+ * of a cell may only be changed if its run is 1.
+ */
 struct List {
 	Term *term;
 	List *next;
+	int run;
 };
 
 struct Binding {
 	const char *name;
 	List *defn;
 	Binding *next;
+	int slot;		/* index in frame; next of frame[0] is outside */
+	unsigned long gen;	/* value of bindgen when defn was last assigned */
 };
 
 struct Tree;
+struct Code;
+struct Symbol;
 
 struct Closure {
 	Binding	*binding;
 	Tree *tree;
+	Code *code;		/* compiled tree, filled in when first run */
+	const char *text;	/* printed form, filled in by closuretext() */
+	unsigned long gen;	/* value of bindgen when text was printed */
 };
 
 
@@ -45,16 +59,21 @@ struct Closure {
  * parse trees
  */
 
+/* changing these, or what the parser builds from them, means bumping
+   FORMAT in parsecache.cxx */
 enum NodeKind {
 	nAssign, nCall, nClosure, nConcat, nFor, nLambda, nLet, nList, nLocal,
 	nMatch, nExtract, nPrim, nQword, nThunk, nVar, nVarsub, nWord,
 	nArith, nPlus, nMinus, nMult, nDivide, nModulus, nPow, nInt, nFloat,
+	nNegate, nCount, nLess, nLessEqual, nGreater, nGreaterEqual, nEqual,
+	nNotEqual,
 	nRedir, nPipe		/* only appear during construction */
 };
 
 // u[?].i is the process id of both sides of a pipe
 struct Tree {
 	NodeKind kind;
+	bool glob;		/* words may hold unquoted wildcards or ~ */
 	union {
 		Tree *p;
 		const char *s;
@@ -72,16 +91,28 @@ struct StrList {
 	StrList *next;
 };
 
-/* environment or arguments */
+/*
+ * which characters of a word were quoted, for glob and match:  the ends
+ * of alternating runs of raw and quoted characters, starting with a raw
+ * run (which may be empty).  most words are quoted or raw throughout, and
+ * share QUOTED or UNQUOTED, whose last run never ends.
+ */
+struct Quote {
+	int n;
+	int end[1];
+};
+
+struct QuoteList {
+	const Quote *quote;
+	QuoteList *next;
+};
+
+/* environment or arguments, terminated by a NULL for execve() */
 // Inherit from gc_cleanup so if the collector ever collects the vector,
 // the internal memory is cleaned up too.
 class Vector : public std::vector< char*, gc_allocator<char*> >, 
 	       public gc_cleanup 
 {
-public: void sort() {
-        extern int qstrcmp(const char *, const char *);
-        std::sort(begin(), end(), qstrcmp);
-    }
 };
 
 
@@ -104,6 +135,7 @@ extern void panic(const char *fmt, ...) NORETURN;
 
 #define	gcnew(type)	new (UseGC) type
 #define galloc	GC_MALLOC
+#define	galloc_atomic	GC_MALLOC_ATOMIC	/* for memory that holds no pointers; not zeroed */
 
 /* util.cxx: copy a counted string into gc space */
 extern char *gcndup(const char* s, size_t n);
@@ -127,17 +159,31 @@ extern void registerfd(int *fdp, bool closeonfork);
 extern void unregisterfd(int *fdp);
 extern void releasefd(int fd);
 extern void closefds(void);
+#if USE_SPAWN
+extern bool spawnfds(posix_spawn_file_actions_t *actions);
+#endif
 
 extern int fdmap(int fd);
 extern int defer_mvfd(bool parent, int oldfd, int newfd);
 extern int defer_close(bool parent, int fd);
 extern void undefer(int ticket);
 
+extern int readbyte(int fd);
+extern int readuntil(int fd, int delim, std::string &line);
+extern void giveback(int fd);
+extern void givebackall(void);
+
 
 /* term.cxx */
 
 extern Term* mkterm(const char* str, Closure* closure);
 extern Term* mkstr(const char* str);
+extern Term *mkint(int64_t i);
+extern Term *mkfloat(double d);
+extern List *mktermcell(const char *str, Closure *closure, List *next);
+extern List *mkstrcell(const char *str, List *next);
+extern List *mkintcell(int64_t i, List *next);
+extern int numval(Term *term);
 extern const char *getstr(Term* term);
 extern Closure *getclosure(Term* term);
 extern Term* termcat(Term* t1, Term*t2);
@@ -148,12 +194,14 @@ extern bool isclosure(Term *term);
 /* list.cxx */
 
 extern List *mklist(Term* term, List* next);
+extern List *mklists(Term **terms, int n, List *next);
 extern List *reverse(List *list);
 extern List *append(const List* head, List* tail);
 extern List *listcopy(const List *list);
 extern int length(List* list);
 extern List *listify(int argc, char **argv);
 extern Term *nth(List *list, int n);
+extern List *nthlist(List *list, int n);
 extern List* sortlist(List* list);
 
 
@@ -161,20 +209,33 @@ extern List* sortlist(List* list);
 
 extern Tree *mk(int, ...);
 /* ... Tree *mk(NodeKind, ...); */
+extern Tree *globscan(Tree *tree);
 
 /* closure.cxx */
 
 extern Closure *mkclosure(Tree* tree, Binding* binding);
 extern Closure *extractbindings(Tree *tree);
 extern Binding *mkbinding(const char* name, List* defn, Binding* next);
+extern Binding *mkframe(int n, Binding* next);
+extern Binding *frameskip(Binding *binding, int depth);
+extern Binding *framelookup(Binding *binding, int depth, int slot);
 extern Binding *reversebindings(Binding *binding);
+extern unsigned long bindgen;
+extern bool reboundsince(List *list, unsigned long gen);
+extern const char *closuretext(Closure *closure);
+
+/* parsecache.cxx */
+
+extern Closure *parseclosure(const char *s);
 
 
 /* eval.cxx */
 
 extern Binding *bindargs(Tree* params, List* args, Binding* binding);
 extern List *forkexec(const char *file, const List *list, bool inchild);
-extern const List *walk(Tree* tree, Binding* binding, int flags);
+extern const List *execute(Code *code, Binding* binding, int flags,
+			   bool tail = false);
+extern const List *tailcall(const List *list, Binding *binding);
 extern const List *eval(const List* list, Binding* binding, int flags);
 extern const List *pathsearch(Term *term);
 
@@ -193,30 +254,55 @@ extern unsigned long evaldepth, maxevaldepth;
 #define	eval_flags		(eval_inchild|eval_exitonfalse)
 
 
+/* compile.cxx */
+
+extern Code *closurecode(Closure *closure);
+
+
 /* glom.cxx */
 
-extern List* glom(Tree* tree, Binding* binding, bool globit);
-extern List *glom2(Tree* tree, Binding* binding, StrList **quotep);
+extern List *concat(List* list1, List* list2);
+extern List *qconcat(List* list1, List* list2,
+		     QuoteList* ql1, QuoteList* ql2, QuoteList **quotep);
+extern List *subscript(List* list, List* subs);
 
 
 /* glob.cxx */
 
-extern const char *QUOTED, *UNQUOTED;
-#define IS_RAW(q) *q == 'r'
+extern const Quote *QUOTED, *UNQUOTED;
+
+/* isquoted -- was character i quoted? */
+inline bool isquoted(const Quote *q, int i) {
+	if (q == UNQUOTED)
+		return false;
+	if (q == QUOTED)
+		return true;
+	int k = 0;
+	while (k < q->n - 1 && i >= q->end[k])
+		k++;
+	return k & 1;
+}
 
-extern List* glob(List* list, StrList* quote);
-extern bool haswild(const char *pattern, const char *quoting);
+extern QuoteList *mkquotelist(const Quote *quote, QuoteList *next);
+extern const Quote *qcat(const Quote *q1, size_t len1,
+			 const Quote *q2, size_t len2);
+extern const Quote *qslice(const Quote *q, size_t start, size_t len);
+extern List* glob(List* list, QuoteList* quote);
+extern bool haswild(const char *pattern, const Quote *quoting);
 /* Needed for some of the readline tab-completion */
 extern List* dirmatch(const char* prefix,
 		      const char* dirname,
 		      const char* pattern,
-		      const char* quote);
+		      const Quote* quote);
 
 
 /* match.cxx */
-extern bool match(const char *subject, const char *pattern, const char *quote);
-extern bool listmatch(List* subject, List* pattern, StrList* quote);
-extern List *extractmatches(List *subjects, List *patterns, StrList *quotes);
+struct Pattern;
+extern Pattern *compilepattern(const char *pattern, const Quote *quote);
+extern bool patternmatch(const Pattern *pattern, const char *subject);
+extern bool match(const char *subject, const char *pattern, const Quote *quote);
+extern bool listmatch(List* subject, List* pattern, QuoteList* quote);
+extern List *extractmatches(List *subjects, List *patterns, QuoteList *quotes);
 
 
 /* var.cxx */
@@ -224,7 +310,9 @@ extern List *extractmatches(List *subjects, List *patterns, StrList *quotes);
 extern void initenv(char **envp, bool isprotected);
 extern void hidevariables(void);
 extern void validatevar(const char *var);
+extern Symbol *intern(const char *name);
 extern List *varlookup(const char* name, Binding* binding);
+extern List *varlookup(Symbol* sym, Binding* binding);
 extern List *varlookup2(const char *name1, const char *name2, Binding *binding);
 extern void vardef(const char*, Binding*, List*);
 extern Vector* mkenv(void);
@@ -238,8 +326,9 @@ class Dyvar {
 public:
 	Dyvar(const char *name, List *defn);
 	~Dyvar();
+	void rebind(List *defn);
 private:
-	const char *name;
+	Symbol *sym;
 	List *defn;
 	int flags;
 };
@@ -262,34 +351,54 @@ extern const char *checkexecutable(const char *file);
 
 extern bool hasforked;
 extern int efork(bool parent, bool background);
+extern int espawn(const char *file, char **argv, char **envp);
 extern int ewait(int pid, bool interruptible, void *rusage);
 #define	ewaitfor(pid)	ewait(pid, false, NULL)
 
 
 /* dict.cxx */
 
-struct Var;
-typedef map<
-		std::string, Var*, 
-		std::less<std::string>, 
-		gc_allocator< std::pair<std::string, Var*> > >
-        Dict_map;
-class Dict : public Dict_map,
-	     public gc_cleanup
-{
+/*
+ * the table of global names: open addressing with linear probing over
+ * a flat array of (hash, Symbol) slots.  symbols are never removed, so
+ * there are no tombstones; iteration yields the symbols that are set,
+ * in no particular order -- use sorted() where order matters.
+ */
+
+class Dict {
 public:
-    Var*& operator[](std::string index) {
-#if ASSERTIONS
-        int icount = count(index);
-#endif
-        Var*& res = Dict_map::operator[](index);
-        assert (res != NULL || icount == 0);
-        return res;
-    }
+	Dict() : slots(NULL), size(0), count(0) {}
+	Symbol *lookup(const char *name);
+	Symbol *intern(const char *name);
+
+	typedef std::vector< Symbol *, gc_allocator<Symbol *> > Symbols;
+	Symbols sorted();
+
+	class iterator {
+	public:
+		iterator(Dict *dict, unsigned long i) : dict(dict), i(i) { skip(); }
+		Symbol *operator*() const { return dict->slots[i].sym; }
+		iterator &operator++() { ++i; skip(); return *this; }
+		bool operator!=(const iterator &other) const { return i != other.i; }
+	private:
+		void skip();
+		Dict *dict;
+		unsigned long i;
+	};
+	iterator begin() { return iterator(this, 0); }
+	iterator end() { return iterator(this, size); }
+
+private:
+	struct Slot {
+		unsigned long hash;
+		Symbol *sym;
+	};
+	void grow();
+
+	Slot *slots;
+	unsigned long size, count;
 };
 
-extern void dictforall(Dict* dict, void (*proc)(void *, const char *, void *),
-                       void* arg);
 /* conv.cxx */
 
 extern void initconv(void);
@@ -315,8 +424,10 @@ extern void *ealloc(size_t n);
 extern void *erealloc(void *p, size_t n);
 extern void ewrite(int fd, const char *s, size_t n);
 extern long eread(int fd, char *buf, size_t n);
+extern void forgetready(int fd);
 extern bool isabsolute(const char *path);
 extern bool streq2(const char *s, const char *t1, const char *t2);
+extern unsigned long strhash(const char *s);
 
 /* efree -- error checked free */
 inline void efree(void *p) {
@@ -372,6 +483,7 @@ extern void initprims(void);
 extern void startsplit(const char *sep, bool coalesce);
 extern void splitstring(const char *in, size_t len, bool endword);
 extern List* endsplit(void);
+extern List *splitbuffer(char *buf, size_t len, const char *sep);
 extern List* fsplit(const char *sep, List* list, bool coalesce);
 
 
@@ -390,12 +502,14 @@ extern void setsigeffects(const Sigeffect effects[]);
 extern void getsigeffects(Sigeffect effects[]);
 extern List *mksiglist(void);
 extern void initsignals(bool interactive, bool allowdumps);
-extern Atomic slow, interrupted;
-extern xs_jmp_buf slowlabel;
+extern Atomic interrupted;
+extern bool waitfds(struct pollfd *fds, int n);
+extern bool waitfd(int fd, short events);
 extern bool sigint_newline;
 extern void sigchk(void);
 extern bool issilentsignal(List *e);
 extern void setsigdefaults(void);
+extern void getsigdefaults(sigset_t *set);
 extern void blocksignals(void);
 extern void unblocksignals(void);
 
@@ -7,6 +7,11 @@
 #define	ASSERTIONS		0
 #endif
 
+/* start external commands with posix_spawn(3) rather than fork(2) */
+#ifndef	USE_SPAWN
+#define	USE_SPAWN		1
+#endif
+
 #define	DEVFD_PATH		"/dev/fd/%d"
 
 #define	INITIAL_PATH		"/usr/bin", "/bin", ""
@@ -0,0 +1,33 @@
+#! /usr/bin/env xs
+
+# Per-command latency of external commands as the heap grows.  "spawn" is
+# the usual path for a simple command; "fork" makes the shell fork first,
+# as it must when xs code runs in the child, so it pays for copying the
+# page tables of the heap.
+#
+#	./build/xs tests/spawn-bench.xs [count]
+
+count = 500
+if {!~ $#* 0} { count = $1 }
+
+fn clock { result `{date +%s%N} }
+
+fn row { |size t0 t1 t2|
+	awk 'BEGIN { printf "%14d %14.1f %14.1f\n", '^$size^', \
+		('^$t1^' - '^$t0^') / 1000 / '^$count^', \
+		('^$t2^' - '^$t1^') / 1000 / '^$count^' }'
+}
+
+echo '    heap words     spawn (us)      fork (us)'
+let (heap = ()) {
+	for size (0 100000 1000000 3000000) {
+		if {!~ $size 0} { heap = `{seq $size} }
+		let (t0 = <=clock; t1 =; t2 =) {
+			for i `{seq $count} { /bin/true }
+			t1 = <=clock
+			for i `{seq $count} { fork { /bin/true } }
+			t2 = <=clock
+			row $size $t0 $t1 $t2
+		}
+	}
+}
@@ -39,11 +39,49 @@ run 'Floating point operation' {
 conds { match '0.5' }
 
 run 'Check invalid integer constant' {
-    echo `(3000000000)
+    echo `(99999999999999999999)
 }
 conds { match 'Could not handle' }
 
+run '64-bit integers' {
+    echo `(3000000000 * 2) `(9223372036854775807 + 1)
+}
+conds { match '6000000000 -9223372036854775808' }
+
+run 'Unary minus' {
+    x = 3
+    echo `(-$x) `(- 2 ** 2) `(4 - -1) `(-1.5)
+}
+conds { match '-3 -4 5 -1.50000' }
+
+run 'Count in arithmetic' {
+    x = a b c
+    echo `($#x * 2) `($#nothing)
+}
+conds { match '6 0' }
+
+run 'Comparison operators' {
+    x = 5
+    echo `($x < 10) `($x <= 4) `($x > 4.5) `($x >= 5) `($x == 5) `($x != 5)
+}
+conds { match '1 0 1 1 1 0' }
+
+run 'Constant subexpressions' {
+    fn f { |n| echo `($n + 2 * 3 - 1) }
+    f 1
+    $&disassemble f
+}
+conds { match '= $n 6 + 1 -' }
+
 run 'Check invalid floating-point constant' {
     echo `(1..01)
 }
 conds { match 'Could not handle' }
+
+run 'Numbers carried between expressions' {
+    i = 0
+    while {!~ $i 5} { i = `($i + 1) }
+    x = `(1 / 0.0)
+    echo $i `($i * 0.5) `($x + 1) $#* <={$&cmp $i 10}
+}
+conds { match '5 2.50000 inf 0 -1' }
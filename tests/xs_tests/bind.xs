@@ -9,3 +9,43 @@ run 'Let without assign' {
 	echo -n $x
 }
 conds { match '35' }
+
+run 'Printed closures follow their bindings' {
+	let (y = 3) {
+		fn-f = {echo $y}
+		fn-g = {|x| y = $x}
+	}
+	fn show { echo $fn-f | sed 's/__id__ = [0-9a-f]*;//' }
+	show
+	g 5
+	show
+	env | grep -c 'y = 5'
+	g 7
+	show
+	env | grep -c 'y = 7'
+}
+conds { match '%closure(y = 3){echo $y}
+%closure(y = 5){echo $y}
+2
+%closure(y = 7){echo $y}
+2' }
+
+run 'Environment follows assignments' {
+	fn vars { env | grep '^xt[a-z]*=' }
+	xtb = 2
+	xta = 1
+	vars
+	local (xtc = 3; xta = 9) vars
+	xtb =
+	vars
+	noexport = xta
+	vars
+	echo done
+}
+conds { match 'xta=1
+xtb=2
+xta=9
+xtb=2
+xtc=3
+xta=1
+done' }
@@ -0,0 +1,69 @@
+run 'Disassemble a thunk' {
+	$&disassemble {echo $x}
+}
+conds expect-success { match '{echo $x}
+   0  mark      
+   1  literal    echo
+   2  lookup     x global
+   3  eval      ' }
+run 'Disassemble a function by name' {
+	fn f { |a| result $a }
+	$&disassemble f
+}
+conds expect-success { match '{|a|result $a}
+   0  mark      
+   1  literal    result
+   2  lexical    a (0, 0)
+   3  eval      ' }
+run 'Disassemble a non-function' {
+	$&disassemble no-such-function
+}
+conds { match 'no-such-function: not a function' }
+run 'Let values see the enclosing scope' {
+	x = 1
+	let (x = 2; y = $x) echo -n $x $y
+}
+conds { match '2 1' }
+run 'Compiled closures keep their bindings' {
+	let (n = 0) fn count { n = `($n + 1); result $n }
+	count; count
+	echo -n <=count
+}
+conds { match '3' }
+run 'Nested for and local' {
+	local (y = a) for i (1 2) { echo -n $y$i }
+}
+conds { match 'a1a2' }
+run 'Lexical variables are addressed by frame and slot' {
+	let (x = 1; y = 2) fn f { |a| for i ($a) { echo -n $y$i$a$x; y = $i } }
+	f 3; f 4
+}
+conds { match '23313441' }
+run 'Closures rebuilt from strings still see their bindings' {
+	let (a = 1) fn f { |x| echo -n $a$x; a = $x }
+	fn-g = $^fn-f
+	g 2; g 3
+}
+conds { match '1223' }
+run 'Literal words are built once' {
+	$&disassemble {x = 'a' 'b' c}
+}
+conds expect-success { match '   3  literal    a b c' }
+run 'Only words that might glob are globbed' {
+	$&disassemble {echo *.c a^$b ~ x}
+}
+conds expect-success { match '   0  mark       quoted
+   1  literal    echo
+   2  word       *.c
+   3  mark      
+   4  literal    a
+   5  mark      
+   6  lookup     b global
+   7  concat    
+   8  word       ~
+   9  literal    x' }
+run 'Literal words survive their values being extended' {
+	fn f { x = 'a' 'b'; x = $x c; y = ~; echo -n $x $#y '' }
+	f; f; f
+}
+conds { match 'a b c 1 a b c 1 a b c 1 ' }
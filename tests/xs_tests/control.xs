@@ -35,3 +35,32 @@ run 'Throw from escape' {
     }
 }
 conds {match a b c}
+
+run 'Tail calls run in constant stack' {
+	fn count { |n|
+		if {!~ $n 0} {
+			count `($n - 1)
+		} else {
+			echo done
+		}
+	}
+	count 5000
+}
+conds { match done }
+
+run 'Long %and chain' {
+	x = ()
+	for i `{seq 2000} { x = $x true }
+	%and $x && echo good
+}
+conds { match good }
+
+run '$0 follows tail calls' {
+	fn f { |n| echo $0 }
+	fn g { |n| echo $0; f $n }
+	fn outer { |n| g $n; echo $0 }
+	outer 1
+}
+conds { match 'g
+f
+outer' }
@@ -2,3 +2,55 @@ run 'Eval echo' {
 	eval echo _test
 }
 conds expect-success { match _test }
+
+run 'Closures from strings are shared' {
+	fn-f = '{|a| echo $a}'
+	fn-g = '{|a| echo $a}'
+	f 1; g 2; f 3
+}
+conds { match '1
+2
+3' }
+
+run 'Parse cache file' {
+	XS_PARSE_CACHE = `pwd^/cache
+	for i (1 2) { $XS -c 'fn-f = ''{|a| for i $a {echo $i}}''; f a b' }
+	test -s cache && echo cached
+}
+conds { match 'a
+b
+a
+b
+cached' }
+
+run 'Parse cache file from another version' {
+	XS_PARSE_CACHE = `pwd^/cache
+	echo 'xs parse cache 1' > cache
+	$XS -c 'fn-f = ''{echo ok}''; f'
+	head -1 cache
+}
+conds { match 'ok
+xs parse cache 2 ' }
+
+run 'Parse cache file too large to use' {
+	XS_PARSE_CACHE = `pwd^/cache
+	head -c 3000000 /dev/zero > cache
+	for i (1 2) { $XS -c 'fn-f = ''{echo ok}''; f' }
+	wc -c < cache
+}
+conds { match 'ok
+ok
+3000000' }
+
+run 'Variable values are shared, not changed' {
+	x = a b c
+	y = $x
+	z = $x d
+	args = w 1 out {echo $x}
+	$&openfile $args
+	x = e
+	echo $y / $z / $args / $x^1 <={result $y}
+	cat out
+}
+conds { match 'a b c / a b c d / w 1 out {echo $x} / e1 a b c
+a b c' }
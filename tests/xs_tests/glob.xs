@@ -36,3 +36,11 @@ run '*/* glob matches expected files' {
 	 echo */*
 }
 conds expect-success { match _.x/lsdkfj a/b b/c  }
+
+run 'Quoted and variable parts of a glob stay literal' {
+	touch ab.c
+	touch '*.c'
+	x = '*'
+	echo a^*.c $x^.c '*'^.c
+}
+conds expect-success { match 'ab.c *.c *.c' }
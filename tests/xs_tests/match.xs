@@ -57,3 +57,35 @@ run 'match multiple subjects and patterns, multiple matches' {
     echo -n <={~ (blop blip blep) *lo? ?le[ap]}
 }
 conds { match-abs 0 }
+
+run 'Quoting a class across concatenated words' {
+	~ x [x'y'] && echo -n 1
+	~ - [a'-'c] && echo -n 2
+	~ b [a'-'c] || echo -n 3
+}
+conds { match '123' }
+
+run 'Many stars match without backtracking' {
+	~ aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa *a*a*a*a*a*a*a*a*a*b || echo -n 1
+	~ aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab *a*a*a*a*a*a*a*a*a*b && echo -n 2
+	echo -n <={~~ xaybzc *a*b*c}
+}
+conds { match '12x y z' }
+
+run 'A matcher tests words against its wildcards' {
+	fn-m = <={matcher '*.c' 'a?'}
+	m x.c && echo -n 1
+	m zz ab && echo -n 2
+	m zz '*' || echo -n 3
+}
+conds { match '123' }
+
+run 'Many subjects against many patterns' {
+	let (p = `{seq 70}) {
+		~ (x y 70) $p && echo -n 1
+		~ (x y 71) $p || echo -n 2
+	}
+	~ (a.o b.o c.h) *.c *.x *.y *.z *.h && echo -n 3
+	echo -n <={~~ (ab.c xy.h ab.h) a*.h *.c x*.? *.h}
+}
+conds { match '123ab y h b' }
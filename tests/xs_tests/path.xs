@@ -0,0 +1,57 @@
+run 'Path search finds commands' {
+	mkdir a b
+	echo '#!/bin/sh
+echo b' > b/tool
+	chmod +x b/tool
+	path = `pwd^/a `pwd^/b $path
+	tool
+	hash | grep -c b/tool
+}
+conds { match 'b
+1' }
+
+run 'Path cache notices new commands' {
+	mkdir a b
+	echo '#!/bin/sh
+echo b' > b/tool
+	echo '#!/bin/sh
+echo a' > a/new
+	chmod +x a/new b/tool
+	path = `pwd^/a `pwd^/b $path
+	tool
+	mv a/new a/tool
+	tool
+	rm a/tool
+	tool
+}
+conds { match 'b
+a
+b' }
+
+run 'Path cache forgets on path change' {
+	mkdir a
+	echo '#!/bin/sh
+echo a' > a/tool
+	chmod +x a/tool
+	path = `pwd^/a $path
+	tool
+	path = /nonexistent
+	catch { |e type msg| echo $msg } { tool }
+	hash -r
+	hash
+}
+conds { match 'a
+tool: No such file or directory' }
+
+run 'Hash rejects arguments besides -r' {
+	catch { |e type msg| echo $msg } { hash -r foo }
+	catch { |e type msg| echo $msg } { hash foo -r }
+}
+conds { match 'usage: hash [-r]
+usage: hash [-r]' }
+
+run 'Pathsearch can be overridden' {
+	fn %pathsearch { |name| result /bin/echo }
+	nosuchcommand hi
+}
+conds { match hi }
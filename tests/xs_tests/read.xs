@@ -0,0 +1,42 @@
+run 'read leaves the rest of a file' {
+	seq 5 > f
+	{ x = <={read}; echo $x `{cat} } < f
+}
+conds { match '1 2 3 4 5' }
+
+run 'read gives back what it read ahead before a fork' {
+	seq 5 > f
+	{ x = <={read -n 2}; true `{true}; echo $x <={read -n 9} } < f
+}
+conds { match '1 2 3 4 5' }
+
+run 'read from a pipe' {
+	seq 3 | { x = <={read}; echo $x `{cat} }
+}
+conds { match '1 2 3' }
+
+run 'read with a delimiter' {
+	echo -n a:b::c > f
+	{ echo <={read -d :} <={read -n 5 -d :} } < f
+}
+conds { match 'a b  c' }
+
+run 'getc from a pipe' {
+	echo abc | { echo <={$&getc} <={$&getc} `{cat} }
+}
+conds { match 'a b c' }
+
+run 'lines runs a body for each line' {
+	seq 5 > f
+	lines 0 {|l| echo -n $l} < f
+	echo -n ' '
+	lines -n 2 0 {|*| echo -n '('$^*')'} < f
+}
+conds { match '12345 (1 2)(3 4)(5)' }
+
+run 'lines stops at break' {
+	seq 5 > f
+	echo -n <={lines 0 {|l| if {~ $l 3} {throw break three}} < f}
+	echo -n '' <={byline {|l| if {~ $l 2} {throw break two}} < f}
+}
+conds { match 'three two' }
@@ -7,3 +7,9 @@ run 'Bad command input redirection' {
 	echo <{/dev/null}
 }
 conds { match '/dev/null: Permission denied' }
+
+run 'Redirections onto descriptors that later ones were opened on' {
+	for f (a b c d e f g h i j) {echo -n $f > $f}
+	/bin/sh -c 'for fd in 10 11 12 13 14 15 16 17 18 19; do cat /dev/fd/$fd; done' <[10] a <[11] b <[12] c <[13] d <[14] e <[15] f <[16] g <[17] h <[18] i <[19] j
+}
+conds { match 'abcdefghij' }
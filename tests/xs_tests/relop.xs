@@ -216,3 +216,11 @@ run 'String :ne comparison' {
     echo yes
 }
 conds { match 'yes' }
+
+run 'Comparison is the same before and after a number is printed' {
+    a = `(16777217.0); b = `(16777216.0)
+    x = <={$&cmp $a $b}
+    echo $a $b > /dev/null
+    echo $x <={$&cmp $a $b} <={$&cmp 9007199254740993 9007199254740992}
+}
+conds { match '1 1 1' }
@@ -11,3 +11,50 @@ run 'split' {
 	}
 }
 conds { match '5 a b c d efg' }
+
+run 'Backquote words across reads' {
+	let (x = `{seq 100000}) {
+		echo $#x $x(4095 4096 4097) $x($#x)
+	}
+}
+conds { match '100000 4095 4096 4097 100000' }
+
+run 'Many separators and long words' {
+	let (x = <={%fsplit ':;,.' 'aaaaaaaaaaaaaaaaaaaaaaaaaa;b,,c.' d}) {
+		echo $#x $^x
+	}
+}
+conds { match '5 aaaaaaaaaaaaaaaaaaaaaaaaaa b  c d' }
+
+run 'Backquote with no separators' {
+	let (x = ``'' {echo ' a  b '}; y = ``'' {true}) {
+		echo -n $#x $#y
+		~ $x ' a  b '\n && echo -n ' same'
+	}
+}
+conds { match '1 0 same' }
+
+run 'Long backquote output' {
+	let (x = ``'' {seq 200000}; y = ``\n {seq 200000}) {
+		echo <={%count <={%fsplit \n $x}} $#y $y($#y)
+	}
+}
+conds { match '200000 200000 200000' }
+
+run 'Kept backquote results stay small' {
+	fn rss {
+		if {access -f /proc/$pid/status} {
+			let (r = `{grep VmRSS /proc/$pid/status}) result $r(2)
+		} {
+			result 0
+		}
+	}
+	let (before = <=rss; after = ; keep = ) {
+		for i `{seq 1000} { keep = $keep `{echo x} }
+		after = <=rss
+		echo -n $#keep ''
+		# each buffer was 64k before it was cut down, so 64M in all
+		`($after - $before) :lt 32768 && echo small
+	}
+}
+conds { match '1000 small' }
@@ -81,3 +81,19 @@ run 'Subscript missing index' {
     }
 }
 conds { match () }
+
+run 'Subscript across joined lists' {
+    let (l = a b c; m = ) {
+        m = x $l y $l
+        echo $m(2 4 ... 6) $#m $m($#m)
+    }
+}
+conds { match 'a c y a 8 c' }
+
+run 'Count follows a redefined %count' {
+    let (l = a b c) {
+        fn %count { result many }
+        echo $#l
+    }
+}
+conds { match 'many' }